@@ -0,0 +1,57 @@
+#pragma once
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "sphere.hpp"
+#include "moving_sphere.hpp"
+#include "instance.hpp"
+#include "transform.hpp"
+
+// Procedural animation over a frame sequence. Each track poses part of the
+// scene for a sequence time t in [0, 1) (frame / frame count) by editing it
+// in place: moving primitives, or changing an instance's transform. Tracks
+// must leave every bounding_box() current and must not move emitters; the
+// scene then only needs Scene::refit_top_level() before the next frame.
+class Animation {
+public:
+    void add(std::function<void(double)> track) { tracks.push_back(std::move(track)); }
+
+    bool empty() const { return tracks.empty(); }
+
+    void pose(double t) const {
+        for (const auto& track : tracks) track(t);
+    }
+
+private:
+    std::vector<std::function<void(double)>> tracks;
+};
+
+// Spins an instance `turns` times about its own vertical axis over the
+// sequence, starting from the transform it has now
+inline void add_turntable(Animation& anim, Instance& inst, double turns) {
+    const Transform rest = inst.xf;
+    anim.add([&inst, rest, turns](double t) {
+        inst.xf = rest * Transform::rotate_y(360.0 * turns * t);
+        inst.update_box();
+    });
+}
+
+// Bounces a sphere `bounces` times over the sequence, up to `height` above
+// where it rests now
+inline void add_bounce(Animation& anim, Sphere& s, double height, int bounces) {
+    const Vec3 rest = s.center;
+    anim.add([&s, rest, height, bounces](double t) {
+        s.center = rest + Vec3(0, height * std::fabs(std::sin(PI * bounces * t)), 0);
+    });
+}
+
+// The same for a sphere already moving within each frame's shutter
+inline void add_bounce(Animation& anim, MovingSphere& s, double height, int bounces) {
+    const Vec3 rest0 = s.center0, rest1 = s.center1;
+    anim.add([&s, rest0, rest1, height, bounces](double t) {
+        Vec3 up(0, height * std::fabs(std::sin(PI * bounces * t)), 0);
+        s.center0 = rest0 + up;
+        s.center1 = rest1 + up;
+    });
+}
@@ -0,0 +1,498 @@
+// Benchmark suite: per-primitive kernels, BVH build/traversal scaling and
+// end-to-end rays/sec on the Cornell room. Results go to stdout (or --json)
+// as one JSON document so runs can be diffed and tracked over time.
+//
+//   g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vec3.hpp"
+#include "ray.hpp"
+#include "aabb.hpp"
+#include "onb.hpp"
+#include "sampler.hpp"
+#include "lights.hpp"
+#include "bvh.hpp"
+#include "linear_bvh.hpp"
+#include "wide_bvh.hpp"
+#include "scene.hpp"
+#include "wavefront.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+#include "cornell.hpp"
+#include "postprocess.hpp"
+#include "film.hpp"
+
+// ----------------------- BENCH CONFIG ------------------------
+static const double MIN_TIME_MS  = 200.0;   // each microbenchmark runs at least this long
+static const size_t RAY_POOL     = 4096;    // pre-generated rays per kernel benchmark
+static const size_t MAX_PRIMS    = 1000000; // largest generated scene (--max-prims 10000000 for the full sweep)
+static const size_t TRAVERSAL_RAYS = 1 << 16;
+static const int    RENDER_SPP   = 4;
+static const int    RENDER_DEPTH = 8;
+// -------------------------------------------------------------
+
+struct BenchSettings {
+    std::string json_path;              // empty => stdout
+    double min_time_ms = MIN_TIME_MS;
+    size_t max_prims   = MAX_PRIMS;
+    int    threads     = 0;             // 0 => one per hardware thread
+    int    spp         = RENDER_SPP;
+    SimdLevel simd     = detect_simd();
+    uint64_t seed      = 1;
+    bool micro = true, bvh = true, render = true;
+};
+
+static void print_usage(const char* argv0){
+    std::cerr << "usage: " << argv0
+              << " [--json out.json] [--min-time MS] [--max-prims N] [--threads N] [--spp N]"
+              << " [--simd auto|scalar|sse|avx2] [--seed N] [--only micro|bvh|render]\n";
+}
+
+static bool parse_args(int argc, char** argv, BenchSettings& bs){
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (a + 1 >= argc) { print_usage(argv[0]); return false; }
+        std::string val = argv[++a];
+        if      (arg == "--json")      bs.json_path   = val;
+        else if (arg == "--min-time")  bs.min_time_ms = std::max(1.0, std::atof(val.c_str()));
+        else if (arg == "--max-prims") bs.max_prims   = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--threads")   bs.threads     = std::max(0, std::atoi(val.c_str()));
+        else if (arg == "--spp")       bs.spp         = std::max(1, std::atoi(val.c_str()));
+        else if (arg == "--seed")      bs.seed        = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--simd") {
+            if (!parse_simd_level(val, bs.simd)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--only") {
+            bs.micro  = val == "micro";
+            bs.bvh    = val == "bvh";
+            bs.render = val == "render";
+            if (!bs.micro && !bs.bvh && !bs.render) { print_usage(argv[0]); return false; }
+        }
+        else { print_usage(argv[0]); return false; }
+    }
+    return true;
+}
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0){
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// Keeps results alive so the optimiser cannot drop the timed work
+static volatile double g_sink;
+
+// One JSON object per measurement, kept as already-formatted "key": value
+// fields so each section can carry its own columns
+struct JsonRecord {
+    std::vector<std::pair<std::string, std::string>> fields;
+
+    JsonRecord& set(const std::string& k, const std::string& v) {
+        std::string q = "\"";
+        for (char c : v) { if (c == '"' || c == '\\') q += '\\'; q += c; }
+        fields.emplace_back(k, q + "\"");
+        return *this;
+    }
+    JsonRecord& set(const std::string& k, double v) {
+        std::ostringstream os;
+        os.precision(6);
+        if (std::isfinite(v)) os << v; else os << "null";
+        fields.emplace_back(k, os.str());
+        return *this;
+    }
+    JsonRecord& set(const std::string& k, uint64_t v) { fields.emplace_back(k, std::to_string(v)); return *this; }
+    JsonRecord& set(const std::string& k, int v)      { fields.emplace_back(k, std::to_string(v)); return *this; }
+
+    void write(std::ostream& os) const {
+        os << "{";
+        for (size_t i = 0; i < fields.size(); ++i)
+            os << (i ? ", " : "") << "\"" << fields[i].first << "\": " << fields[i].second;
+        os << "}";
+    }
+};
+
+static void write_section(std::ostream& os, const char* name, const std::vector<JsonRecord>& recs, bool last){
+    os << "  \"" << name << "\": [";
+    for (size_t i = 0; i < recs.size(); ++i) {
+        os << (i ? ",\n    " : "\n    ");
+        recs[i].write(os);
+    }
+    os << (recs.empty() ? "]" : "\n  ]") << (last ? "\n" : ",\n");
+}
+
+// ---------------------------------------------------------------------------
+// Microbenchmarks
+
+// Runs `body(i)` over i = 0.. in batches of `batch` until min_ms has passed;
+// returns nanoseconds per call
+template <class F>
+static double time_per_call(double min_ms, size_t batch, F&& body, uint64_t& calls){
+    calls = 0;
+    auto t0 = Clock::now();
+    double elapsed = 0.0;
+    do {
+        for (size_t i = 0; i < batch; ++i) body(i);
+        calls += batch;
+        elapsed = ms_since(t0);
+    } while (elapsed < min_ms);
+    return elapsed * 1e6 / double(calls);
+}
+
+// Rays from a shell around the unit cube aimed at points in a slightly larger
+// cube, so roughly half of them hit a unit-sized primitive at the origin
+static std::vector<Ray> make_rays(size_t n, double shell, double spread, uint64_t seed){
+    Sampler s(seed);
+    s.start(0, 0);
+    std::vector<Ray> rays(n);
+    for (size_t i = 0; i < n; ++i) {
+        Vec3 o = shell * random_unit_vector(s);
+        Vec3 target(spread * (2 * s.next_1d() - 1), spread * (2 * s.next_1d() - 1), spread * (2 * s.next_1d() - 1));
+        rays[i] = Ray(o, normalize(target - o));
+    }
+    return rays;
+}
+
+// Returns false when a SIMD kernel's output differs from the scalar one
+static bool bench_micro(const BenchSettings& bs, std::vector<JsonRecord>& out){
+    const std::vector<Ray> rays = make_rays(RAY_POOL, 3.0, 1.5, bs.seed);
+    const size_t mask = RAY_POOL - 1;
+    const Real inf = std::numeric_limits<Real>::infinity();
+
+    auto record = [&](const char* name, double ns, uint64_t calls, uint64_t hits){
+        JsonRecord r;
+        r.set("name", name).set("ns_per_call", ns).set("calls", calls);
+        if (hits != uint64_t(-1)) r.set("hit_rate", double(hits) / double(calls));
+        out.push_back(r);
+        std::cerr << "  " << name << ": " << ns << " ns\n";
+    };
+
+    // Intersection kernels: each batch walks the whole ray pool once
+    auto bench_hit = [&](const char* name, auto&& hit){
+        uint64_t calls, hits = 0;
+        double ns = time_per_call(bs.min_time_ms, RAY_POOL, [&](size_t i){ hits += hit(rays[i & mask]); }, calls);
+        record(name, ns, calls, hits);
+    };
+
+    AABB box(Vec3(-1,-1,-1), Vec3(1,1,1));
+    bench_hit("AABB::hit", [&](const Ray& r){ return box.hit(r, 0, inf); });
+
+    Sphere sphere(Vec3(0,0,0), 1.0, 0);
+    XYRect xy(-1, 1, -1, 1, 0, 0);
+    XZRect xz(-1, 1, -1, 1, 0, 0);
+    YZRect yz(-1, 1, -1, 1, 0, 0);
+    HitRecord rec;
+    bench_hit("Sphere::hit", [&](const Ray& r){ return sphere.hit(r, 0, inf, rec); });
+    bench_hit("XYRect::hit", [&](const Ray& r){ return xy.hit(r, 0, inf, rec); });
+    bench_hit("XZRect::hit", [&](const Ray& r){ return xz.hit(r, 0, inf, rec); });
+    bench_hit("YZRect::hit", [&](const Ray& r){ return yz.hit(r, 0, inf, rec); });
+    g_sink = rec.t;
+
+    // Sampling helpers: one sampler stream, restarted every batch
+    Sampler s(bs.seed);
+    auto bench_sample = [&](const char* name, auto&& draw){
+        uint64_t calls;
+        double acc = 0.0;
+        s.start(0, 0);
+        double ns = time_per_call(bs.min_time_ms, 1024, [&](size_t){ acc += draw(); }, calls);
+        g_sink = acc;
+        record(name, ns, calls, uint64_t(-1));
+    };
+
+    bench_sample("Sampler::next_1d",        [&]{ return s.next_1d(); });
+    bench_sample("Sampler::next_2d",        [&]{ return s.next_2d().v; });
+    // Low-discrepancy samplers: a new sample index (of the first 1024) every
+    // 64 dimensions, roughly what a path uses
+    Sampler sobol(bs.seed, SamplerType::Sobol), halton(bs.seed, SamplerType::Halton);
+    uint32_t ld_index = 0;
+    auto ld = [&](Sampler& ls) -> Sampler& {
+        if (ls.dimension() >= 64) ls.start(0, ++ld_index % 1024);
+        return ls;
+    };
+    bench_sample("Sampler::next_1d (sobol)",  [&]{ return ld(sobol).next_1d(); });
+    bench_sample("Sampler::next_2d (sobol)",  [&]{ return ld(sobol).next_2d().v; });
+    bench_sample("Sampler::next_1d (halton)", [&]{ return ld(halton).next_1d(); });
+    bench_sample("random_in_unit_sphere",   [&]{ return random_in_unit_sphere(s).x; });
+    bench_sample("random_unit_vector",      [&]{ return random_unit_vector(s).x; });
+    bench_sample("random_in_unit_disk",     [&]{ return random_in_unit_disk(s).x; });
+    bench_sample("random_cosine_direction", [&]{ return random_cosine_direction(s).z; });
+    ONB onb;
+    bench_sample("ONB::build_from_w",       [&]{ onb.build_from_w(Vec3(s.next_1d(), 1, 0.5)); return onb.u.x; });
+
+    const Vec3 p(0, 1, -1), le(1, 1, 1);
+    Light rect   = Light::rect(Vec3(-0.4, 1.95, -1.0), Vec3(0.8, 0, 0), Vec3(0, 0, 0.8), le);
+    Light sph    = Light::sphere(Vec3(0, 3, 0), 0.5, le);
+    Light tri    = Light::triangle(Vec3(-1, 2, -2), Vec3(1, 2, -2), Vec3(0, 2, 0), le);
+    LightSample ls;
+    bench_sample("Light::sample (rect)",     [&]{ return rect.sample(p, s, ls) ? ls.pdf : 0.0; });
+    bench_sample("Light::sample (sphere)",   [&]{ return sph.sample(p, s, ls) ? ls.pdf : 0.0; });
+    bench_sample("Light::sample (triangle)", [&]{ return tri.sample(p, s, ls) ? ls.pdf : 0.0; });
+
+    // Display transform per pixel on a 640x360 film of radiances spanning
+    // a few stops either side of the exposure, one row per call, at every
+    // SIMD level up to --simd. Each level must match the scalar bytes
+    // exactly, scalar tail included (the length is not a multiple of 8).
+    HdrImage film;
+    film.resize(640, 360);
+    for (float& v : film.rgb) v = float(std::exp2(12.0 * s.next_1d() - 6.0));
+    ToneMap tm;
+    bool exact = true;
+    const size_t check_n = film.rgb.size() - 5;
+    std::vector<unsigned char> img(film.rgb.size()), ref(check_n);
+    tonemap_scalar(tm, film.rgb.data(), ref.data(), check_n);
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2}) {
+        if (int(level) > int(bs.simd)) break;
+        tonemap(tm, film.rgb.data(), img.data(), check_n, level);
+        size_t differ = 0;
+        for (size_t i = 0; i < check_n; ++i) differ += img[i] != ref[i];
+        if (differ) {
+            std::cerr << "  tonemap (" << simd_name(level) << "): " << differ << " bytes differ from scalar\n";
+            exact = false;
+        }
+        uint64_t calls;
+        const size_t row = size_t(film.width) * 3;
+        double ns = time_per_call(bs.min_time_ms, size_t(film.height), [&](size_t y){
+            tonemap(tm, film.row(int(y)), &img[y * row], row, level);
+        }, calls);
+        g_sink = img[calls % img.size()];
+        const std::string name = std::string("tonemap per pixel (") + simd_name(level) + ")";
+        record(name.c_str(), ns / film.width, calls * uint64_t(film.width), uint64_t(-1));
+    }
+
+    // Film: adding one sample to a tile's buffer with each filter, and an
+    // uncontended atomic splat
+    Film fb;
+    fb.reset(64, 64);
+    const Tile ftile{16, 16, 48, 48};
+    FilmTile ft;
+    const Vec3 radiance(0.5, 0.25, 1.0);
+    for (FilterType type : {FilterType::Box, FilterType::Gaussian, FilterType::Mitchell, FilterType::BlackmanHarris}) {
+        const Filter filter(type);
+        ft.begin(fb, ftile, filter);
+        uint32_t k = 0;
+        const std::string name = std::string("FilmTile::add (") + filter_name(type) + ")";
+        bench_sample(name.c_str(), [&]{
+            ++k;
+            ft.add(16 + int(k & 31), 16 + int((k >> 5) & 31), s.next_1d() - 0.5, s.next_1d() - 0.5, radiance);
+            return 0.0;
+        });
+    }
+    const Filter gaussian(FilterType::Gaussian);
+    bench_sample("Film::splat (gaussian)", [&]{
+        fb.splat(64 * s.next_1d(), 64 * s.next_1d(), radiance, gaussian);
+        return 0.0;
+    });
+    return exact;
+}
+
+// ---------------------------------------------------------------------------
+// BVH build and traversal on generated scenes
+
+// n spheres scattered through the unit cube, sized so they cover it about once
+static void make_spheres(Scene& scene, size_t n, uint64_t seed){
+    Sampler s(seed);
+    s.start(1, 0);
+    MaterialId m = scene.add_material(Material::lambertian(Vec3(0.5, 0.5, 0.5)));
+    double r = 0.5 / std::cbrt(double(n));
+    scene.objects.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        scene.add<Sphere>(Vec3(2 * s.next_1d() - 1, 2 * s.next_1d() - 1, 2 * s.next_1d() - 1), r, m);
+}
+
+// A triangle soup with the same density as make_spheres()
+static MeshData make_triangles(size_t n, uint64_t seed){
+    Sampler s(seed);
+    s.start(2, 0);
+    MeshData m;
+    m.px.reserve(3 * n); m.py.reserve(3 * n); m.pz.reserve(3 * n);
+    m.indices.reserve(3 * n);
+    double r = 1.0 / std::cbrt(double(n));
+    for (size_t i = 0; i < n; ++i) {
+        double cx = 2 * s.next_1d() - 1, cy = 2 * s.next_1d() - 1, cz = 2 * s.next_1d() - 1;
+        for (int v = 0; v < 3; ++v) {
+            m.indices.push_back(uint32_t(m.px.size()));
+            m.px.push_back(float(cx + r * (s.next_1d() - 0.5)));
+            m.py.push_back(float(cy + r * (s.next_1d() - 0.5)));
+            m.pz.push_back(float(cz + r * (s.next_1d() - 0.5)));
+        }
+    }
+    return m;
+}
+
+// Closest-hit rays/sec through `h`
+static double traversal_mrays(const Hittable& h, const std::vector<Ray>& rays, uint64_t& hits){
+    const Real inf = std::numeric_limits<Real>::infinity();
+    HitRecord rec;
+    hits = 0;
+    auto t0 = Clock::now();
+    for (const Ray& r : rays) hits += h.hit(r, 0, inf, rec);
+    double ms = ms_since(t0);
+    g_sink = rec.t;
+    return double(rays.size()) / (ms * 1e3);
+}
+
+static void bench_bvh(const BenchSettings& bs, std::vector<JsonRecord>& out){
+    const std::vector<Ray> rays = make_rays(TRAVERSAL_RAYS, 3.0, 1.0, bs.seed + 1);
+    BVHBuildOptions opts;
+
+    for (size_t n = 10; n <= bs.max_prims; n *= 10) {
+        // Object BVH over individual Sphere primitives, as the top level is built
+        {
+            Scene scene;
+            make_spheres(scene, n, bs.seed);
+            BVHBuildStats stats;
+            auto t0 = Clock::now();
+            scene.build_top_level(opts, &stats);
+            double build_ms = ms_since(t0);
+            scene.build_accel(8, bs.simd);
+
+            uint64_t hits;
+            double bvh2  = traversal_mrays(*scene.flat, rays, hits);
+            double wide8 = traversal_mrays(*scene.accel, rays, hits);
+            JsonRecord r;
+            r.set("scene", "spheres").set("prims", uint64_t(n)).set("build_ms", build_ms)
+             .set("nodes", uint64_t(stats.nodes)).set("leaves", uint64_t(stats.leaves))
+             .set("max_depth", stats.max_depth).set("sah_cost", stats.sah_cost)
+             .set("bvh2_mrays_per_s", bvh2).set("wide8_mrays_per_s", wide8)
+             .set("hit_rate", double(hits) / double(rays.size()));
+            out.push_back(r);
+            std::cerr << "  spheres " << n << ": build " << build_ms << " ms, "
+                      << bvh2 << " / " << wide8 << " Mrays/s (bvh2 / wide8)\n";
+        }
+        // Mesh BVH over SoA triangles
+        {
+            MeshData data = make_triangles(n, bs.seed);
+            auto t0 = Clock::now();
+            TriangleMesh mesh(std::move(data), 0, opts);
+            double build_ms = ms_since(t0);
+
+            uint64_t hits;
+            double mrays = traversal_mrays(mesh, rays, hits);
+            JsonRecord r;
+            r.set("scene", "triangles").set("prims", uint64_t(n)).set("build_ms", build_ms)
+             .set("nodes", uint64_t(mesh.build_stats.nodes)).set("leaves", uint64_t(mesh.build_stats.leaves))
+             .set("max_depth", mesh.build_stats.max_depth).set("sah_cost", mesh.build_stats.sah_cost)
+             .set("bvh2_mrays_per_s", mrays).set("memory_bytes", uint64_t(mesh.memory_bytes()))
+             .set("hit_rate", double(hits) / double(rays.size()));
+            out.push_back(r);
+            std::cerr << "  triangles " << n << ": build " << build_ms << " ms, " << mrays << " Mrays/s\n";
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// End-to-end: the Cornell room as raytracer.cpp renders it
+
+static void bench_render(const BenchSettings& bs, std::vector<JsonRecord>& out){
+    const int width = 640, height = 360;
+    Scene scene;
+    CornellRoom room = build_cornell_room(scene, double(width) / height, 0.0);
+    scene.build_top_level(BVHBuildOptions());
+    scene.collect_lights(LightSelect::Power);
+    scene.build_accel(8, bs.simd);
+
+    const unsigned threads = bs.threads > 0 ? unsigned(bs.threads)
+                                            : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Tile> tiles = make_tiles(width, height, 32, TileOrder::Hilbert);
+
+    // Camera rays alone, one per pixel, single-threaded
+    {
+        const Real inf = std::numeric_limits<Real>::infinity();
+        Sampler s(bs.seed);
+        std::vector<Ray> rays;
+        rays.reserve(size_t(width) * height);
+        for (int j = 0; j < height; ++j)
+            for (int i = 0; i < width; ++i) {
+                s.start(uint64_t(j) * width + i, 0);
+                rays.push_back(room.camera.get_ray((i + s.next_1d()) / (width - 1),
+                                                   (j + s.next_1d()) / (height - 1), s));
+            }
+        HitRecord rec;
+        uint64_t hits = 0;
+        auto t0 = Clock::now();
+        for (const Ray& r : rays) hits += scene.hit(r, 0, inf, rec);
+        double ms = ms_since(t0);
+        JsonRecord r;
+        r.set("name", "camera_rays").set("threads", 1).set("rays", uint64_t(rays.size()))
+         .set("seconds", ms / 1e3).set("mrays_per_s", double(rays.size()) / (ms * 1e3))
+         .set("hit_rate", double(hits) / double(rays.size()));
+        out.push_back(r);
+        std::cerr << "  camera rays: " << double(rays.size()) / (ms * 1e3) << " Mrays/s\n";
+    }
+
+    // Full path tracing with the wavefront integrator, single rays vs packets
+    for (int packet : {1, 8}) {
+        WavefrontParams wf;
+        wf.width = width;
+        wf.height = height;
+        wf.spp = bs.spp;
+        wf.max_depth = RENDER_DEPTH;
+        wf.light_samples = 1;
+        wf.brdf_samples = 1;
+        wf.seed = bs.seed;
+        wf.packet_size = packet;
+        wf.simd = bs.simd;
+
+        WorkStealingPool pool(threads);
+        std::vector<WavefrontIntegrator> integrators(pool.size(), WavefrontIntegrator(scene, room.camera, wf));
+        auto t0 = Clock::now();
+        pool.run(tiles.size(), [&](size_t t, unsigned worker){
+            std::vector<Vec3> sums;
+            integrators[worker].render_tile(tiles[t], sums);
+        });
+        double ms = ms_since(t0);
+
+        uint64_t rays = 0;
+        for (const auto& it : integrators) rays += it.rays_traced;
+        const uint64_t samples = uint64_t(width) * height * bs.spp;
+        JsonRecord r;
+        r.set("name", packet > 1 ? "path_trace_packet8" : "path_trace").set("threads", int(pool.size()))
+         .set("spp", bs.spp).set("max_depth", RENDER_DEPTH).set("rays", rays).set("seconds", ms / 1e3)
+         .set("mrays_per_s", double(rays) / (ms * 1e3)).set("msamples_per_s", double(samples) / (ms * 1e3));
+        out.push_back(r);
+        std::cerr << "  path trace (packet " << packet << "): " << double(rays) / (ms * 1e3) << " Mrays/s\n";
+    }
+}
+
+int main(int argc, char** argv){
+    BenchSettings bs;
+    if (!parse_args(argc, argv, bs)) return 1;
+
+    std::vector<JsonRecord> micro, bvh, render;
+    bool exact = true;
+    if (bs.micro)  { std::cerr << "Kernels\n";      exact = bench_micro(bs, micro); }
+    if (bs.bvh)    { std::cerr << "BVH scaling\n";  bench_bvh(bs, bvh); }
+    if (bs.render) { std::cerr << "Cornell room\n"; bench_render(bs, render); }
+
+    std::ofstream file;
+    if (!bs.json_path.empty()) {
+        file.open(bs.json_path);
+        if (!file) { std::cerr << "cannot write " << bs.json_path << "\n"; return 1; }
+    }
+    std::ostream& os = bs.json_path.empty() ? std::cout : file;
+
+    JsonRecord build;
+    build.set("precision", sizeof(Real) == sizeof(float) ? "float" : "double")
+         .set("simd", simd_name(bs.simd))
+         .set("compiler", __VERSION__)
+         .set("seed", bs.seed);
+    os << "{\n  \"build\": ";
+    build.write(os);
+    os << ",\n";
+    write_section(os, "micro", micro, false);
+    write_section(os, "bvh", bvh, false);
+    write_section(os, "render", render, true);
+    os << "}\n";
+    return exact ? 0 : 1;
+}
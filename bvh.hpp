@@ -1,64 +1,96 @@
 #pragma once
 #include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <memory>
 #include <vector>
 #include "hittable.hpp"
 #include "aabb.hpp"
+#include "bvh_build.hpp"
 #include "vec3.hpp"
 
 class BVHNode : public Hittable {
 public:
-    std::shared_ptr<Hittable> left;
-    std::shared_ptr<Hittable> right;
+    std::unique_ptr<BVHNode> left;
+    std::unique_ptr<BVHNode> right;
+    std::vector<const Hittable*> prims; // leaf primitives (empty for interior nodes)
     AABB box;
+    int axis = 0; // split axis of interior nodes
 
     BVHNode() {}
 
-    BVHNode(std::vector<std::shared_ptr<Hittable>>& src, size_t start, size_t end) {
-        size_t span = end - start;
-        int axis = int(3.0 * random_double()); // 0,1,2
+    // Builds over src[start, end) with a binned SAH (or the legacy median
+    // split); stats, if given, receive build time and tree quality.
+    BVHNode(const std::vector<const Hittable*>& src, size_t start, size_t end,
+            const BVHBuildOptions& opts = BVHBuildOptions(), BVHBuildStats* stats = nullptr) {
+        auto t0 = std::chrono::steady_clock::now();
 
-        auto box_less = [axis](const std::shared_ptr<Hittable>& a,
-                               const std::shared_ptr<Hittable>& b) {
-            AABB ba, bb;
-            if (!a->bounding_box(ba) || !b->bounding_box(bb))
-                std::cerr << "BVH: missing bounding_box()\n";
-            if (axis == 0) return ba.min().x < bb.min().x;
-            if (axis == 1) return ba.min().y < bb.min().y;
-            return ba.min().z < bb.min().z;
-        };
-
-        if (span == 1) {
-            left = right = src[start];
-        } else if (span == 2) {
-            if (box_less(src[start], src[start+1])) {
-                left = src[start]; right = src[start+1];
-            } else {
-                left = src[start+1]; right = src[start];
-            }
-        } else {
-            std::sort(src.begin() + start, src.begin() + end, box_less);
-            size_t mid = start + span/2;
-            left  = std::make_shared<BVHNode>(src, start, mid);
-            right = std::make_shared<BVHNode>(src, mid, end);
+        std::vector<BVHPrimInfo> info;
+        info.reserve(end - start);
+        for (size_t i = start; i < end; ++i) {
+            AABB b;
+            if (!src[i]->bounding_box(b)) std::cerr << "BVH: missing bounding_box()\n";
+            info.push_back({b, 0.5 * (b.min() + b.max()), uint32_t(i)});
         }
 
-        AABB bl, br;
-        left->bounding_box(bl);
-        right->bounding_box(br);
-        box = surrounding_box(bl, br);
+        auto root = BVHBuilder(info, opts).build();
+        if (!root) return;
+        assign(*root, info, src);
+
+        if (stats) {
+            bvh_tree_stats(*root, opts, *stats);
+            stats->build_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - t0).count();
+        }
     }
 
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
         if (!box.hit(r, t_min, t_max)) return false;
 
+        if (!prims.empty()) {
+            bool hit_anything = false;
+            for (const Hittable* p : prims) {
+                if (p->hit(r, t_min, t_max, rec)) {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+            return hit_anything;
+        }
+
         bool hit_left  = left->hit(r, t_min, t_max, rec);
         bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
         return hit_left || hit_right;
     }
 
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        if (!box.hit(r, t_min, t_max)) return false;
+        if (!prims.empty()) {
+            for (const Hittable* p : prims)
+                if (p->occluded(r, t_min, t_max)) return true;
+            return false;
+        }
+        return left->occluded(r, t_min, t_max) || right->occluded(r, t_min, t_max);
+    }
+
     bool bounding_box(AABB& out_box) const override {
         out_box = box;
         return true;
     }
+
+private:
+    void assign(const BVHBuildNode& n, const std::vector<BVHPrimInfo>& info,
+                const std::vector<const Hittable*>& src) {
+        box = n.box;
+        axis = n.axis;
+        if (n.is_leaf()) {
+            for (uint32_t i = n.first; i < n.first + n.count; ++i)
+                prims.push_back(src[info[i].index]);
+            return;
+        }
+        left = std::make_unique<BVHNode>();
+        right = std::make_unique<BVHNode>();
+        left->assign(*n.child[0], info, src);
+        right->assign(*n.child[1], info, src);
+    }
 };
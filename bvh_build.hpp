@@ -0,0 +1,270 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "aabb.hpp"
+#include "sampler.hpp"
+
+// Geometry-agnostic BVH construction.
+// Builders only see per-primitive bounds and centroids; they reorder the
+// BVHPrimInfo array so every node covers a contiguous [first, first+count)
+// range of it, and return a build tree that the runtime BVHs convert into
+// their own layout.
+
+enum class BVHBuildMethod { SAH, Median };
+
+inline bool parse_bvh_method(const std::string& s, BVHBuildMethod& out) {
+    if (s == "sah")    { out = BVHBuildMethod::SAH;    return true; }
+    if (s == "median") { out = BVHBuildMethod::Median; return true; }
+    return false;
+}
+
+struct BVHBuildOptions {
+    BVHBuildMethod method = BVHBuildMethod::SAH;
+    int    bins           = 16;   // SAH bins per axis
+    double traversal_cost = 1.0;  // cost of visiting a node, relative to...
+    double intersect_cost = 1.0;  // ...one primitive test
+    int    max_leaf_size  = 8;    // leaves never exceed this, even if cheaper
+    size_t parallel_threshold = 4096; // subtrees at least this big build on their own thread
+};
+
+struct BVHBuildStats {
+    double build_ms  = 0.0;
+    double sah_cost  = 0.0; // expected cost per ray, normalised by root area
+    size_t nodes     = 0;
+    size_t leaves    = 0;
+    int    max_depth = 0;
+};
+
+struct BVHPrimInfo {
+    AABB     box;
+    Vec3     centroid;
+    uint32_t index; // into the caller's primitive array
+};
+
+struct BVHBuildNode {
+    AABB box;
+    std::unique_ptr<BVHBuildNode> child[2];
+    uint32_t first = 0, count = 0; // primitive range (leaves only)
+    int axis = 0;                  // split axis (interior only)
+
+    bool is_leaf() const { return !child[0]; }
+};
+
+inline double surface_area(const AABB& b) {
+    Vec3 d = b.max() - b.min();
+    return 2.0 * (d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+inline double axis_of(const Vec3& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+inline AABB empty_box() {
+    const double inf = std::numeric_limits<double>::infinity();
+    return AABB(Vec3(inf, inf, inf), Vec3(-inf, -inf, -inf));
+}
+
+inline AABB grow(const AABB& b, const Vec3& p) {
+    return AABB(Vec3(std::min(b.min().x, p.x), std::min(b.min().y, p.y), std::min(b.min().z, p.z)),
+                Vec3(std::max(b.max().x, p.x), std::max(b.max().y, p.y), std::max(b.max().z, p.z)));
+}
+
+class BVHBuilder {
+public:
+    // Below this depth SAH splits give way to object-median splits, which
+    // bounds the tree depth (and the traversal stacks) at about 64.
+    static constexpr int SAH_MAX_DEPTH = 32;
+
+    BVHBuilder(std::vector<BVHPrimInfo>& prims, const BVHBuildOptions& opts)
+        : prims(prims), opts(opts) {
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        while ((1u << parallel_depth) < hw * 2) ++parallel_depth;
+    }
+
+    std::unique_ptr<BVHBuildNode> build() {
+        if (prims.empty()) return nullptr;
+        return build_range(0, uint32_t(prims.size()), 0);
+    }
+
+private:
+    std::vector<BVHPrimInfo>& prims;
+    BVHBuildOptions opts;
+    int parallel_depth = 0;
+
+    std::unique_ptr<BVHBuildNode> make_leaf(const AABB& box, uint32_t first, uint32_t count) {
+        auto node = std::make_unique<BVHBuildNode>();
+        node->box = box;
+        node->first = first;
+        node->count = count;
+        return node;
+    }
+
+    std::unique_ptr<BVHBuildNode> build_range(uint32_t first, uint32_t last, int depth) {
+        const uint32_t count = last - first;
+
+        AABB box = prims[first].box;
+        AABB cbox = AABB(prims[first].centroid, prims[first].centroid);
+        for (uint32_t i = first + 1; i < last; ++i) {
+            box  = surrounding_box(box, prims[i].box);
+            cbox = grow(cbox, prims[i].centroid);
+        }
+
+        if (count == 1) return make_leaf(box, first, count);
+
+        int axis = 0;
+        uint32_t mid = first + count / 2;
+        if (opts.method == BVHBuildMethod::Median) {
+            if (!split_median(first, last, axis)) return make_leaf(box, first, count);
+        } else if (depth >= SAH_MAX_DEPTH) {
+            split_object_median(cbox, first, last, axis);
+        } else if (!split_sah(box, cbox, first, last, axis, mid)) {
+            return make_leaf(box, first, count);
+        }
+
+        auto node = std::make_unique<BVHBuildNode>();
+        node->box = box;
+        node->axis = axis;
+        if (count >= opts.parallel_threshold && depth < parallel_depth) {
+            auto left = std::async(std::launch::async,
+                                   [this, first, mid, depth]{ return build_range(first, mid, depth + 1); });
+            node->child[1] = build_range(mid, last, depth + 1);
+            node->child[0] = left.get();
+        } else {
+            node->child[0] = build_range(first, mid, depth + 1);
+            node->child[1] = build_range(mid, last, depth + 1);
+        }
+        return node;
+    }
+
+    // The original builder: random axis, sort by box minimum, split in half,
+    // one primitive per leaf. Kept as a baseline for build comparisons.
+    bool split_median(uint32_t first, uint32_t last, int& axis) {
+        Sampler axis_rng;
+        axis_rng.start(first, last);
+        axis = int(3.0 * axis_rng.next_1d());
+        std::sort(prims.begin() + first, prims.begin() + last,
+                  [axis](const BVHPrimInfo& a, const BVHPrimInfo& b) {
+                      return axis_of(a.box.min(), axis) < axis_of(b.box.min(), axis);
+                  });
+        return true;
+    }
+
+    // Halve the range at the centroid median of the widest axis
+    void split_object_median(const AABB& cbox, uint32_t first, uint32_t last, int& axis) {
+        Vec3 d = cbox.max() - cbox.min();
+        axis = (d.x > d.y && d.x > d.z) ? 0 : (d.y > d.z ? 1 : 2);
+        std::nth_element(prims.begin() + first, prims.begin() + first + (last - first) / 2,
+                         prims.begin() + last,
+                         [axis](const BVHPrimInfo& a, const BVHPrimInfo& b) {
+                             return axis_of(a.centroid, axis) < axis_of(b.centroid, axis);
+                         });
+    }
+
+    // Binned SAH over centroids. Returns false when a leaf is cheaper than
+    // the best split (and small enough to be allowed).
+    bool split_sah(const AABB& box, const AABB& cbox, uint32_t first, uint32_t last,
+                   int& best_axis, uint32_t& mid) {
+        const uint32_t count = last - first;
+        const int nb = std::max(2, opts.bins);
+        const double leaf_cost = opts.intersect_cost * count;
+        const double inv_area = 1.0 / std::max(surface_area(box), 1e-300);
+
+        double best_cost = std::numeric_limits<double>::infinity();
+        int best_bin = -1;
+        best_axis = -1;
+
+        struct Bin { AABB box = empty_box(); uint32_t count = 0; };
+        std::vector<Bin> bins(nb);
+        std::vector<double> right_area(nb);
+        std::vector<uint32_t> right_count(nb);
+
+        for (int axis = 0; axis < 3; ++axis) {
+            double cmin = axis_of(cbox.min(), axis);
+            double extent = axis_of(cbox.max(), axis) - cmin;
+            if (extent <= 0.0) continue;
+            double scale = nb / extent;
+
+            std::fill(bins.begin(), bins.end(), Bin());
+            for (uint32_t i = first; i < last; ++i) {
+                int b = std::min(nb - 1, int((axis_of(prims[i].centroid, axis) - cmin) * scale));
+                bins[b].box = surrounding_box(bins[b].box, prims[i].box);
+                bins[b].count++;
+            }
+
+            // Sweep right-to-left, then left-to-right evaluating each plane
+            AABB acc = empty_box();
+            uint32_t n = 0;
+            for (int b = nb - 1; b > 0; --b) {
+                acc = surrounding_box(acc, bins[b].box);
+                n += bins[b].count;
+                right_area[b] = n ? surface_area(acc) : 0.0;
+                right_count[b] = n;
+            }
+            acc = empty_box();
+            n = 0;
+            for (int b = 0; b < nb - 1; ++b) {
+                acc = surrounding_box(acc, bins[b].box);
+                n += bins[b].count;
+                if (n == 0 || right_count[b + 1] == 0) continue;
+                double cost = opts.traversal_cost + opts.intersect_cost * inv_area *
+                              (surface_area(acc) * n + right_area[b + 1] * right_count[b + 1]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin  = b;
+                }
+            }
+        }
+
+        if (best_axis < 0) {
+            // All centroids coincide: no plane separates them
+            if (count <= uint32_t(opts.max_leaf_size)) return false;
+            best_axis = 0;
+            mid = first + count / 2;
+            return true;
+        }
+        if (best_cost >= leaf_cost && count <= uint32_t(opts.max_leaf_size)) return false;
+
+        double cmin = axis_of(cbox.min(), best_axis);
+        double scale = nb / (axis_of(cbox.max(), best_axis) - cmin);
+        auto it = std::partition(prims.begin() + first, prims.begin() + last,
+            [&](const BVHPrimInfo& p) {
+                int b = std::min(nb - 1, int((axis_of(p.centroid, best_axis) - cmin) * scale));
+                return b <= best_bin;
+            });
+        mid = uint32_t(it - prims.begin());
+        if (mid == first || mid == last) mid = first + count / 2;
+        return true;
+    }
+};
+
+// Walks a finished build tree to fill in node counts and the SAH cost
+inline void bvh_tree_stats(const BVHBuildNode& root, const BVHBuildOptions& opts, BVHBuildStats& stats) {
+    const double inv_root = 1.0 / std::max(surface_area(root.box), 1e-300);
+    stats.sah_cost = 0.0;
+    stats.nodes = stats.leaves = 0;
+    stats.max_depth = 0;
+
+    std::vector<std::pair<const BVHBuildNode*, int>> stack{{&root, 0}};
+    while (!stack.empty()) {
+        auto [n, depth] = stack.back();
+        stack.pop_back();
+        stats.nodes++;
+        stats.max_depth = std::max(stats.max_depth, depth);
+        double rel = surface_area(n->box) * inv_root;
+        if (n->is_leaf()) {
+            stats.leaves++;
+            stats.sah_cost += rel * opts.intersect_cost * n->count;
+        } else {
+            stats.sah_cost += rel * opts.traversal_cost;
+            stack.push_back({n->child[0].get(), depth + 1});
+            stack.push_back({n->child[1].get(), depth + 1});
+        }
+    }
+}
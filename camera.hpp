@@ -8,25 +8,25 @@ public:
     Vec3 horizontal;
     Vec3 vertical;
     Vec3 u, v, w;           // camera basis
-    double lens_radius;     // aperture/2
-    double time0, time1;    // shutter open/close
+    Real lens_radius;     // aperture/2
+    Real time0, time1;    // shutter open/close
 
     Camera(
         Vec3 lookfrom   = Vec3(3,3,2),
         Vec3 lookat     = Vec3(0,0,-1),
         Vec3 vup        = Vec3(0,1,0),
-        double vfov_deg = 45.0,       // vertical FOV in degrees
-        double aspect   = 2.0,        // width/height
-        double aperture = 0.0,        // 0 => pinhole
-        double focus_dist = 3.4,      // distance to focus plane
-        double t0 = 0.0,              // shutter open
-        double t1 = 1.0               // shutter close
+        Real vfov_deg = 45.0,       // vertical FOV in degrees
+        Real aspect   = 2.0,        // width/height
+        Real aperture = 0.0,        // 0 => pinhole
+        Real focus_dist = 3.4,      // distance to focus plane
+        Real t0 = 0.0,              // shutter open
+        Real t1 = 1.0               // shutter close
     ) : lens_radius(aperture * 0.5), time0(t0), time1(t1)
     {
-        double theta = vfov_deg * (PI / 180.0);
-        double h = tan(theta / 2.0);
-        double viewport_height = 2.0 * h;
-        double viewport_width  = aspect * viewport_height;
+        Real theta = vfov_deg * (PI / 180.0);
+        Real h = tan(theta / 2.0);
+        Real viewport_height = 2.0 * h;
+        Real viewport_width  = aspect * viewport_height;
 
         w = normalize(lookfrom - lookat);
         u = normalize(cross(vup, w));
@@ -38,13 +38,14 @@ public:
         lower_left_corner = origin - horizontal*0.5 - vertical*0.5 - focus_dist * w;
     }
 
-    Ray get_ray(double s, double t) const {
+    // Draws the lens and time dimensions (3) of a camera sample
+    Ray get_ray(Real s, Real t, Sampler& sampler) const {
         // Depth of field: sample a disk aperture
-        Vec3 rd = lens_radius * random_in_unit_disk();
+        Vec3 rd = lens_radius * random_in_unit_disk(sampler);
         Vec3 offset = u * rd.x + v * rd.y;
 
         // Motion blur: sample time in shutter interval
-        double time = random_double(time0, time1);
+        Real time = sampler.next_1d(time0, time1);
 
         return Ray(
             origin + offset,
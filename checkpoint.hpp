@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "vec3.hpp"
+#include "denoise.hpp"
+#include "film.hpp"
+
+// Progressive render state: the radiance sum, the sum of squared sample
+// luminance, the first-hit feature sums and the sample count of every pixel
+// (row-major, top row first), in HDR, before exposure and tone mapping, and
+// the filtered film the image is resolved from. The sums cover the samples
+// taken in each pixel: with the squares they give each pixel's variance for
+// adaptive sampling and the denoiser, the features guide the denoiser.
+// Samples come from the counter-based sampler, so the seed and the counts
+// are the whole RNG state: pixel p simply continues at sample index
+// samples[p], and a resumed render matches one that was never interrupted.
+
+static constexpr uint32_t CHECKPOINT_VERSION = 4;
+
+struct RenderProgress {
+    int      width = 0, height = 0;
+    uint64_t seed = 0;
+    uint64_t key = 0;               // hash of the settings the sums depend on (scene, depth, ...)
+    std::vector<Vec3> sum;
+    std::vector<double> sum_sq;
+    std::vector<Features> features;
+    std::vector<uint32_t> samples;
+    Film film;
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        sum.assign(size_t(w) * h, Vec3(0,0,0));
+        sum_sq.assign(size_t(w) * h, 0.0);
+        features.assign(size_t(w) * h, Features());
+        samples.assign(size_t(w) * h, 0);
+        film.reset(w, h);
+    }
+
+    // Noise of every pixel for adaptive sampling, as it will show in the
+    // output: how far one standard error of the mean luminance moves the
+    // pixel through `to_display` (radiance -> display value, i.e. exposure,
+    // tone curve and gamma), up or down, whichever is further; the gamma
+    // makes the downward side the larger one in dark pixels. Mean and
+    // variance are averaged over the (2 radius + 1)^2 window around the
+    // pixel first: a single pixel's variance from a few samples of a
+    // heavy-tailed estimator is often far too low and would stop it early,
+    // the window pools its neighbours' evidence. Pixels with fewer than two
+    // samples get an infinite error.
+    template <class ToDisplay>
+    void display_error(ToDisplay&& to_display, int radius, std::vector<double>& out) const {
+        const size_t n_pix = samples.size();
+        std::vector<double> mean(n_pix), var(n_pix);   // var: variance of the mean estimate
+        for (size_t p = 0; p < n_pix; ++p) {
+            mean[p] = samples[p] ? luminance(sum[p]) / samples[p] : 0.0;
+            var[p] = mean_variance(p);
+        }
+        box_filter(mean, radius);
+        box_filter(var, radius);
+        out.resize(n_pix);
+        for (size_t p = 0; p < n_pix; ++p) {
+            if (samples[p] < 2 || !std::isfinite(var[p])) {
+                out[p] = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            const double m = std::max(0.0, mean[p]), se = std::sqrt(var[p]);
+            out[p] = std::max(to_display(m + se) - to_display(m), to_display(m) - to_display(std::max(0.0, m - se)));
+        }
+    }
+
+    // What the denoiser filters: the film's radiance, variance of the mean
+    // luminance and mean features of every pixel
+    void means(std::vector<Vec3>& color, std::vector<double>& variance, std::vector<Features>& guide) const {
+        color.resize(sum.size());
+        variance.resize(sum.size());
+        guide.resize(sum.size());
+        for (size_t p = 0; p < sum.size(); ++p) {
+            color[p] = film.resolve(p);
+            variance[p] = samples[p] > 1 ? mean_variance(p) : 0.0;
+            guide[p] = features[p].mean(samples[p]);
+        }
+    }
+
+    double mean_samples() const {
+        double total = 0.0;
+        for (uint32_t s : samples) total += s;
+        return samples.empty() ? 0.0 : total / double(samples.size());
+    }
+
+    uint32_t min_samples() const {
+        uint32_t m = samples.empty() ? 0 : samples[0];
+        for (uint32_t s : samples) m = s < m ? s : m;
+        return m;
+    }
+
+private:
+    // Variance of pixel p's mean luminance estimate, infinite below two samples
+    double mean_variance(size_t p) const {
+        const double n = samples[p];
+        if (n < 2) return std::numeric_limits<double>::infinity();
+        const double m = luminance(sum[p]) / n;
+        return std::max(0.0, sum_sq[p] / n - m * m) / (n - 1);
+    }
+
+    // Separable box average over the image, clamped at the borders
+    void box_filter(std::vector<double>& v, int radius) const {
+        std::vector<double> tmp(v.size());
+        for (int pass = 0; pass < 2; ++pass) {
+            const int len = pass ? height : width, lines = pass ? width : height;
+            const size_t step = pass ? size_t(width) : 1, line_step = pass ? 1 : size_t(width);
+            for (int l = 0; l < lines; ++l)
+                for (int k = 0; k < len; ++k) {
+                    const int a = std::max(0, k - radius), b = std::min(len - 1, k + radius);
+                    double s = 0.0;
+                    for (int m = a; m <= b; ++m) s += v[l * line_step + m * step];
+                    tmp[l * line_step + k * step] = s / (b - a + 1);
+                }
+            v.swap(tmp);
+        }
+    }
+};
+
+struct CheckpointHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t endian;     // 0x01020304 as written by the producing host
+    int32_t  width, height;
+    uint64_t seed;
+    uint64_t key;
+};
+
+// Sums are stored as doubles whatever Real is, features as 7 doubles
+// (albedo, normal, depth), the film as 4 (filtered RGB, weight) plus 3 of
+// splats; written to a temporary file
+// and renamed over `path`, so a job killed mid-write keeps the previous one
+inline bool save_checkpoint(const std::string& path, const RenderProgress& p) {
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) { std::cerr << "checkpoint: cannot write " << tmp << "\n"; return false; }
+
+    CheckpointHeader h{};
+    std::memcpy(h.magic, "RTCKPT", 7);
+    h.version = CHECKPOINT_VERSION;
+    h.endian = 0x01020304u;
+    h.width = p.width;
+    h.height = p.height;
+    h.seed = p.seed;
+    h.key = p.key;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    std::vector<double> rgb(p.sum.size() * 3);
+    for (size_t i = 0; i < p.sum.size(); ++i) {
+        rgb[3 * i] = p.sum[i].x; rgb[3 * i + 1] = p.sum[i].y; rgb[3 * i + 2] = p.sum[i].z;
+    }
+    out.write(reinterpret_cast<const char*>(rgb.data()), std::streamsize(rgb.size() * sizeof(double)));
+    out.write(reinterpret_cast<const char*>(p.sum_sq.data()), std::streamsize(p.sum_sq.size() * sizeof(double)));
+    std::vector<double> aov(p.features.size() * 7);
+    for (size_t i = 0; i < p.features.size(); ++i) {
+        const Features& f = p.features[i];
+        const double v[7] = {f.albedo.x, f.albedo.y, f.albedo.z, f.normal.x, f.normal.y, f.normal.z, f.depth};
+        std::copy(v, v + 7, &aov[7 * i]);
+    }
+    out.write(reinterpret_cast<const char*>(aov.data()), std::streamsize(aov.size() * sizeof(double)));
+    std::vector<double> film(p.film.pixels.size() * 7);
+    for (size_t i = 0; i < p.film.pixels.size(); ++i) {
+        const FilmPixel& f = p.film.pixels[i];
+        const Vec3 s = p.film.splat_value(i);
+        const double v[7] = {f.r, f.g, f.b, f.weight, s.x, s.y, s.z};
+        std::copy(v, v + 7, &film[7 * i]);
+    }
+    out.write(reinterpret_cast<const char*>(film.data()), std::streamsize(film.size() * sizeof(double)));
+    out.write(reinterpret_cast<const char*>(p.samples.data()), std::streamsize(p.samples.size() * sizeof(uint32_t)));
+    out.close();
+    if (!out) { std::cerr << "checkpoint: write failed\n"; return false; }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+inline bool load_checkpoint(const std::string& path, RenderProgress& p) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) { std::cerr << "checkpoint: cannot open " << path << "\n"; return false; }
+
+    in.seekg(0, std::ios::end);
+    const uint64_t file_size = uint64_t(std::max<std::streamoff>(0, in.tellg()));
+    in.seekg(0);
+
+    // The header must also account for the file's exact size before its
+    // dimensions are trusted with an allocation: per pixel, the rgb sums,
+    // sum_sq, 7 feature and 7 film doubles, and the sample count
+    CheckpointHeader h;
+    auto size_matches = [&]() {
+        const uint64_t per_pixel = (3 + 1 + 7 + 7) * sizeof(double) + sizeof(uint32_t);
+        const uint64_t payload = file_size - sizeof(CheckpointHeader);
+        return payload % per_pixel == 0 && payload / per_pixel == uint64_t(h.width) * uint64_t(h.height);
+    };
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || std::memcmp(h.magic, "RTCKPT", 7) != 0 ||
+        h.version != CHECKPOINT_VERSION || h.endian != 0x01020304u || h.width <= 0 || h.height <= 0 ||
+        !size_matches()) {
+        std::cerr << "checkpoint: " << path << " is not a version " << CHECKPOINT_VERSION << " checkpoint\n";
+        return false;
+    }
+
+    p.reset(h.width, h.height);
+    p.seed = h.seed;
+    p.key = h.key;
+    std::vector<double> rgb(p.sum.size() * 3);
+    in.read(reinterpret_cast<char*>(rgb.data()), std::streamsize(rgb.size() * sizeof(double)));
+    in.read(reinterpret_cast<char*>(p.sum_sq.data()), std::streamsize(p.sum_sq.size() * sizeof(double)));
+    std::vector<double> aov(p.features.size() * 7);
+    in.read(reinterpret_cast<char*>(aov.data()), std::streamsize(aov.size() * sizeof(double)));
+    std::vector<double> film(p.film.pixels.size() * 7);
+    in.read(reinterpret_cast<char*>(film.data()), std::streamsize(film.size() * sizeof(double)));
+    in.read(reinterpret_cast<char*>(p.samples.data()), std::streamsize(p.samples.size() * sizeof(uint32_t)));
+    if (!in) { std::cerr << "checkpoint: " << path << " is truncated\n"; return false; }
+    for (size_t i = 0; i < p.sum.size(); ++i)
+        p.sum[i] = Vec3(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+    for (size_t i = 0; i < p.features.size(); ++i) {
+        const double* v = &aov[7 * i];
+        p.features[i].albedo = Vec3(v[0], v[1], v[2]);
+        p.features[i].normal = Vec3(v[3], v[4], v[5]);
+        p.features[i].depth = v[6];
+    }
+    for (size_t i = 0; i < p.film.pixels.size(); ++i) {
+        const double* v = &film[7 * i];
+        p.film.pixels[i] = FilmPixel{v[0], v[1], v[2], v[3]};
+        p.film.set_splat(i, Vec3(v[4], v[5], v[6]));
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "camera.hpp"
+#include "scene.hpp"
+#include "moving_sphere.hpp"
+#include "animation.hpp"
+
+// The Cornell-style room the renderer draws (and the benchmark times): five
+// walls, a ceiling light, a glass and a steel sphere (rising during the
+// shutter when `motion_blur` is set). An optional mesh is placed later by
+// the caller, standing on `mesh_floor`.
+struct CornellRoom {
+    Camera camera;
+    MaterialId white;
+    Vec3   mesh_floor;
+    double mesh_size;
+    Sphere*       steel = nullptr;         // the steel sphere, whichever kind was built
+    MovingSphere* steel_moving = nullptr;
+};
+
+// Adds the room's materials and primitives to `scene`; no BVH is built
+inline CornellRoom build_cornell_room(Scene& scene, double aspect, double aperture, bool motion_blur = false){
+    // Move camera further back & adjust FOV
+    Vec3 lookfrom(0.0, 1.0, 1.2);   // was (0.0, 1.0, 0.90)
+    Vec3 lookat  (0.0, 1.0, -1.10);
+    double focus_dist = (lookfrom - lookat).length();
+
+    double time0 = 0;
+    double time1 = 1;
+
+    Camera cam(lookfrom, lookat, Vec3(0,1,0),
+            50.0,  // wider FOV than before (was 40.0)
+            aspect,
+            aperture, focus_dist,
+            time0, time1);
+
+    // Room bounds
+    const double room_min_x = -1.0, room_max_x =  1.0;
+    const double room_min_y =  0.0, room_max_y =  2.0;
+    const double room_min_z = -2.2, room_max_z =  0.2;
+
+    MaterialId white     = scene.add_material(Material::lambertian(Vec3(0.75, 0.75, 0.75)));
+    MaterialId red       = scene.add_material(Material::lambertian(Vec3(0.75, 0.15, 0.15)));
+    MaterialId green     = scene.add_material(Material::lambertian(Vec3(0.15, 0.75, 0.15)));
+    MaterialId steel     = scene.add_material(Material::metal(Vec3(0.75, 0.75, 0.75), 0.05));
+    MaterialId glass     = scene.add_material(Material::dielectric(1.5));
+    MaterialId light_mat = scene.add_material(Material::diffuse_light(Vec3(1.0, 0.97, 0.92), 8000.0));
+
+    scene.add<XZRect>(room_min_x, room_max_x, room_min_z, room_max_z, room_min_y, white);
+    scene.add<XZRect>(room_min_x, room_max_x, room_min_z, room_max_z, room_max_y, white);
+
+    scene.add<XYRect>(room_min_x, room_max_x, room_min_y, room_max_y, room_min_z, white);
+    scene.add<YZRect>(room_min_y, room_max_y, room_min_z, room_max_z, room_min_x, red);
+    scene.add<YZRect>(room_min_y, room_max_y, room_min_z, room_max_z, room_max_x, green);
+
+    const double Lx0 = -0.4, Lx1 = 0.4;
+    const double Lz0 = -1.0, Lz1 = -0.2;
+    const double Ly  = 1.95;
+    scene.add<XZRect>(Lx0, Lx1, Lz0, Lz1, Ly, light_mat);
+
+    CornellRoom room{cam, white, Vec3(0.0, room_min_y, -1.7), 0.8};
+    scene.add<Sphere>(Vec3(-0.4, 0.35, -1.4), 0.35, glass);
+    if (motion_blur)
+        room.steel_moving = &scene.add<MovingSphere>(Vec3(0.5, 0.50, -1.0), Vec3(0.5, 0.65, -1.0), time0, time1, 0.50, steel);
+    else
+        room.steel = &scene.add<Sphere>(Vec3( 0.5, 0.50, -1.0), 0.50, steel);
+
+    return room;
+}
+
+// The room's animation for sequence renders: the steel sphere bounces
+// twice (up to just under the light). Mesh turntables are added by the
+// caller, which places the mesh.
+inline void animate_cornell_room(Animation& anim, CornellRoom& room) {
+    if (room.steel)        add_bounce(anim, *room.steel, 0.6, 2);
+    if (room.steel_moving) add_bounce(anim, *room.steel_moving, 0.6, 2);
+}
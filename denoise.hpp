@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "vec3.hpp"
+#include "thread_pool.hpp"
+
+// First-hit guide buffers (AOVs): what a camera ray hit, summed over a
+// pixel's samples like its radiance. Noise-free after a few samples, they
+// show the denoiser where the image has edges.
+struct Features {
+    Vec3   albedo = Vec3(0,0,0);   // reflectance at the hit (1 for glass and lights)
+    Vec3   normal = Vec3(0,0,0);   // shading normal, world space
+    double depth  = 0.0;           // distance from the camera; 0 where the ray escaped
+
+    void add(const Features& f) {
+        albedo += f.albedo;
+        normal += f.normal;
+        depth += f.depth;
+    }
+    Features mean(uint32_t samples) const {
+        Features m;
+        if (samples == 0) return m;
+        const double inv = 1.0 / samples;
+        m.albedo = albedo * inv;
+        m.normal = normal * inv;
+        m.depth = depth * inv;
+        return m;
+    }
+};
+
+struct DenoiseSettings {
+    int    levels       = 5;       // a-trous levels: the kernel spans 4 * 2^(levels-1) + 1 pixels
+    double sigma_color  = 4.0;     // luminance stop, in standard deviations of the pixels' noise
+    double sigma_normal = 128.0;   // exponent on the cosine between normals
+    double sigma_depth  = 1.0;     // depth stop, relative to the local depth gradient
+    double sigma_albedo = 0.1;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the
+// variance-guided luminance stop of SVGF (Schied et al. 2017), on the HDR
+// image before tone mapping. `color` is each pixel's mean radiance,
+// `variance` the variance of its mean luminance and `guide` its mean
+// features. Lighting is filtered with the albedo divided out and multiplied
+// back afterwards, so colour edges stay sharp. Each level is a 5x5 B3-spline
+// kernel with taps 2^level pixels apart, rows split over the pool (serial
+// without one).
+class Denoiser {
+public:
+    Denoiser(int width, int height, const DenoiseSettings& settings = {})
+        : width(width), height(height), ds(settings) {}
+
+    void run(const std::vector<Vec3>& color, const std::vector<double>& variance,
+             const std::vector<Features>& guide, std::vector<Vec3>& out, WorkStealingPool* pool) {
+        const size_t n = size_t(width) * height;
+        albedo.resize(n); normal.resize(n); depth.resize(n); depth_grad.resize(n);
+        irr.resize(n); var.resize(n); irr_next.resize(n); var_next.resize(n);
+
+        for (size_t p = 0; p < n; ++p) {
+            const Vec3& a = guide[p].albedo;
+            albedo[p] = Vec3(a.x > ALBEDO_MIN ? a.x : 1.0, a.y > ALBEDO_MIN ? a.y : 1.0, a.z > ALBEDO_MIN ? a.z : 1.0);
+            const double len = guide[p].normal.length();
+            normal[p] = len > 0 ? guide[p].normal / len : Vec3(0,0,0);
+            depth[p] = guide[p].depth;
+            irr[p] = Vec3(color[p].x / albedo[p].x, color[p].y / albedo[p].y, color[p].z / albedo[p].z);
+            const double la = luminance(albedo[p]);
+            var[p] = variance[p] / (la * la);
+        }
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x) {
+                const size_t p = size_t(y) * width + x;
+                const double gx = depth[size_t(y) * width + std::min(x + 1, width - 1)] -
+                                  depth[size_t(y) * width + std::max(x - 1, 0)];
+                const double gy = depth[size_t(std::min(y + 1, height - 1)) * width + x] -
+                                  depth[size_t(std::max(y - 1, 0)) * width + x];
+                depth_grad[p] = 0.5 * std::max(std::fabs(gx), std::fabs(gy));
+            }
+
+        for (int level = 0; level < ds.levels; ++level) {
+            const int step = 1 << level;
+            for_rows(pool, [&](int y0, int y1) { filter_rows(step, y0, y1); });
+            irr.swap(irr_next);
+            var.swap(var_next);
+        }
+
+        out.resize(n);
+        for (size_t p = 0; p < n; ++p) out[p] = irr[p] * albedo[p];
+    }
+
+private:
+    static constexpr double ALBEDO_MIN = 1e-3;
+    static constexpr int    ROWS_PER_TASK = 8;
+
+    int width, height;
+    DenoiseSettings ds;
+    std::vector<Vec3> albedo, normal, irr, irr_next;
+    std::vector<double> depth, depth_grad, var, var_next;
+
+    template <class Fn>
+    void for_rows(WorkStealingPool* pool, Fn&& fn) const {
+        const size_t tasks = size_t(height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+        auto task = [&](size_t t, unsigned) {
+            const int y0 = int(t) * ROWS_PER_TASK;
+            fn(y0, std::min(height, y0 + ROWS_PER_TASK));
+        };
+        if (pool) pool->run(tasks, task);
+        else for (size_t t = 0; t < tasks; ++t) task(t, 0);
+    }
+
+    // Variance under a 3x3 Gaussian: one pixel's estimate is too noisy to
+    // set its own luminance stop
+    double blurred_variance(int x, int y) const {
+        static const double k[3] = {0.25, 0.5, 0.25};
+        double v = 0.0, w = 0.0;
+        for (int dy = -1; dy <= 1; ++dy)
+            for (int dx = -1; dx <= 1; ++dx) {
+                const int qx = x + dx, qy = y + dy;
+                if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+                const double h = k[dx + 1] * k[dy + 1];
+                v += h * var[size_t(qy) * width + qx];
+                w += h;
+            }
+        return v / w;
+    }
+
+    void filter_rows(int step, int y0, int y1) {
+        static const double k[5] = {1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16};
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < width; ++x) {
+                const size_t p = size_t(y) * width + x;
+                const double lp = luminance(irr[p]);
+                const double sigma_l = ds.sigma_color * std::sqrt(std::max(0.0, blurred_variance(x, y))) + 1e-10;
+                const Vec3& np = normal[p];
+                const bool hit_p = depth[p] > 0;
+
+                Vec3 sum(0,0,0);
+                double wsum = 0.0, vsum = 0.0;
+                for (int dy = -2; dy <= 2; ++dy)
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        const int qx = x + dx * step, qy = y + dy * step;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+                        const size_t q = size_t(qy) * width + qx;
+                        if ((depth[q] > 0) != hit_p) continue;
+
+                        // Normals: cos^sigma_normal by repeated squaring (sigma a power of two)
+                        double wn = 1.0;
+                        if (hit_p) {
+                            wn = std::max(0.0, double(dot(np, normal[q])));
+                            for (double e = 1.0; e < ds.sigma_normal; e *= 2.0) wn *= wn;
+                            if (wn <= 0.0) continue;
+                        }
+                        const double dist = step * std::sqrt(double(dx * dx + dy * dy));
+                        const double ez = std::fabs(depth[p] - depth[q]) / (ds.sigma_depth * depth_grad[p] * dist + 1e-6);
+                        const double el = std::fabs(lp - luminance(irr[q])) / sigma_l;
+                        const Vec3 da = albedo[p] - albedo[q];
+                        const double ea = dot(da, da) / (ds.sigma_albedo * ds.sigma_albedo);
+                        const double w = k[dx + 2] * k[dy + 2] * wn * std::exp(-(ez + el + ea));
+
+                        sum += w * irr[q];
+                        wsum += w;
+                        vsum += w * w * var[q];
+                    }
+                if (wsum <= 0.0) {
+                    irr_next[p] = irr[p];
+                    var_next[p] = var[p];
+                    continue;
+                }
+                irr_next[p] = sum / wsum;
+                var_next[p] = vsum / (wsum * wsum);
+            }
+    }
+};
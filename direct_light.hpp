@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include "onb.hpp"
+#include "scene.hpp"
+
+// Next-event estimation on a diffuse surface, split so the ray cast can be
+// done right away (recursive integrator) or queued (wavefront integrator).
+// Both estimators are MIS-weighted against each other with the balance
+// heuristic; `f` is the Lambertian BRDF value albedo/pi. Both rays are cast
+// at the path's `time`, so moving geometry is where the path saw it.
+
+// Light sample: `contribution` counts only if `ray` is unoccluded up to t_max
+struct ShadowQuery {
+    Ray ray;
+    Real t_max;
+    Vec3 contribution;
+};
+
+inline bool sample_light_query(const Scene& scene, const HitRecord& rec, const Vec3& f, Real time,
+                               Sampler& sampler, ShadowQuery& q) {
+    const Vec3& p = rec.point;
+    const Vec3& n = rec.normal;
+    uint32_t li;
+    double pick_pmf;
+    if (!scene.lights.pick(p, n, sampler.next_1d(), li, pick_pmf)) return false;
+    const Light& light = scene.lights[li];
+    LightSample ls;
+    if (!light.sample(p, sampler, ls)) return false;
+
+    double cos_i = dot(n, ls.wi);
+    if (cos_i <= 0.0) return false;
+
+    double pdf_light = pick_pmf * ls.pdf;
+    double pdf_brdf  = cos_i / PI;
+    double w = pdf_light / (pdf_light + pdf_brdf);
+    q.ray = spawn_ray_to(rec, p + Real(ls.dist) * ls.wi, time);
+    q.t_max = 1 - SHADOW_EPSILON;
+    q.contribution = w * light.radiance * f * (cos_i / pdf_light);
+    return true;
+}
+
+// BRDF sample: counts only if the closest hit along `ray` is an emitter
+struct BrdfProbe {
+    Ray ray;
+    double cos_i;
+};
+
+inline bool sample_brdf_probe(const HitRecord& rec, Real time, Sampler& sampler, BrdfProbe& q) {
+    ONB onb; onb.build_from_w(rec.normal);
+    Vec3 wi = onb.local(random_cosine_direction(sampler));
+    q.cos_i = std::max(0.0, double(dot(rec.normal, wi)));
+    if (q.cos_i <= 0.0) return false;
+    q.ray = spawn_ray(rec, wi, time);
+    return true;
+}
+
+// What a probe adds once its closest hit `lrec` is known
+inline Vec3 brdf_probe_contribution(const Scene& scene, const Vec3& n, const Vec3& f,
+                                    const BrdfProbe& q, const HitRecord& lrec) {
+    if (lrec.light == NO_LIGHT) return Vec3(0,0,0);
+    const Vec3& p  = q.ray.origin;
+    const Vec3& wi = q.ray.direction;
+    const Light& light = scene.lights[lrec.light];
+    double pdf_light = scene.lights.pick_pmf(p, n, lrec.light) *
+                       light.pdf(p, wi, lrec.t * wi.length());
+    double pdf_brdf = q.cos_i / PI;
+    double w = pdf_brdf / (pdf_brdf + pdf_light);
+    return w * light.radiance * f * (q.cos_i / pdf_brdf);
+}
@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vec3.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+
+// Pixel reconstruction: every sample is spread over the pixels within the
+// filter's radius of it, weighted by the filter, and a pixel's value is
+// sum(w L) / sum(w). The box filter keeps a sample in its own pixel, i.e.
+// the plain per-pixel average.
+enum class FilterType { Box, Gaussian, Mitchell, BlackmanHarris };
+
+inline const char* filter_name(FilterType t) {
+    switch (t) {
+    case FilterType::Gaussian:       return "gaussian";
+    case FilterType::Mitchell:       return "mitchell";
+    case FilterType::BlackmanHarris: return "blackman-harris";
+    default:                         return "box";
+    }
+}
+
+inline bool parse_filter_type(const std::string& s, FilterType& out) {
+    if      (s == "box")             out = FilterType::Box;
+    else if (s == "gaussian")        out = FilterType::Gaussian;
+    else if (s == "mitchell")        out = FilterType::Mitchell;
+    else if (s == "blackman-harris") out = FilterType::BlackmanHarris;
+    else return false;
+    return true;
+}
+
+// Separable filter, w(dx, dy) = eval(dx) * eval(dy), in pixels. The 1D
+// profile is tabulated once and interpolated linearly: each sample needs it
+// at 2 (2 margin + 1) offsets.
+class Filter {
+public:
+    explicit Filter(FilterType type = FilterType::Box) : type(type) {
+        switch (type) {
+        case FilterType::Box:            radius = 0.5; break;
+        case FilterType::Gaussian:       radius = 1.5; break;   // sigma 0.5
+        case FilterType::Mitchell:       radius = 2.0; break;   // B = C = 1/3
+        case FilterType::BlackmanHarris: radius = 1.5; break;
+        }
+        margin = int(std::ceil(radius + 0.5)) - 1;
+        for (int i = 0; i < TABLE_SIZE; ++i) table[i] = profile(radius * i / (TABLE_SIZE - 1));
+        double sum = 0.0;
+        const int steps = 1024;
+        for (int k = 0; k < steps; ++k) sum += eval(radius * (2.0 * (k + 0.5) / steps - 1.0));
+        integral = sum * 2.0 * radius / steps;
+        integral *= integral;
+    }
+
+    FilterType type;
+    double radius;     // pixels with centres closer than this (per axis) get the sample
+    int    margin;     // the most pixels a sample reaches beyond its own, per axis
+    double integral;   // of w over the plane
+
+    double eval(double d) const {
+        const double x = std::fabs(d) * ((TABLE_SIZE - 1) / radius);
+        if (x >= TABLE_SIZE - 1) return 0.0;
+        const int i = int(x);
+        return table[i] + (x - i) * (table[i + 1] - table[i]);
+    }
+
+    // Weights of the pixels -margin..margin away along one axis, for a
+    // sample at `offset` in [-0.5, 0.5] from its own pixel's centre. The own
+    // pixel always counts, so a box sample on a pixel edge is not lost.
+    void weights(double offset, double* w) const {
+        for (int k = -margin; k <= margin; ++k)
+            w[k + margin] = k == 0 ? (type == FilterType::Box ? 1.0 : eval(offset))
+                                   : (std::fabs(offset - k) < radius ? eval(offset - k) : 0.0);
+    }
+
+private:
+    static constexpr int TABLE_SIZE = 256;
+    double table[TABLE_SIZE];
+
+    // The exact 1D profile at distance d in [0, radius]
+    double profile(double d) const {
+        switch (type) {
+        case FilterType::Gaussian: {
+            const double inv_2s2 = 1.0 / (2.0 * 0.5 * 0.5);
+            return std::max(0.0, std::exp(-d * d * inv_2s2) - std::exp(-radius * radius * inv_2s2));
+        }
+        case FilterType::Mitchell: {
+            const double B = 1.0 / 3.0, C = 1.0 / 3.0, x = 2.0 * d / radius;
+            if (x < 1.0)
+                return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0;
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0;
+        }
+        case FilterType::BlackmanHarris: {
+            const double t = 2.0 * PI * (0.5 + 0.5 * d / radius);
+            return 0.35875 - 0.48829 * std::cos(t) + 0.14128 * std::cos(2 * t) - 0.01168 * std::cos(3 * t);
+        }
+        default:
+            return 1.0;
+        }
+    }
+};
+
+struct FilmPixel {
+    double r = 0.0, g = 0.0, b = 0.0;
+    double weight = 0.0;
+};
+
+class FilmTile;
+
+// The image: filtered sums per pixel (row-major, top row first) and a splat
+// buffer. Tiles own their pixels while they render (FilmTile) and their
+// contributions to neighbouring tiles are merged after each pass, so the
+// sums come out the same in every run whatever the thread count. splat()
+// is for contributions that can land anywhere (light tracing): it adds
+// atomically, without locks.
+class Film {
+public:
+    int width = 0, height = 0;
+    std::vector<FilmPixel> pixels;
+    double splat_scale = 1.0;   // splats are scaled by this when resolved, e.g. 1 / light paths per pixel
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        pixels.assign(size_t(w) * h, FilmPixel());
+        splats.reset(new std::atomic<double>[size_t(w) * h * 3]);
+        for (size_t i = 0; i < size_t(w) * h * 3; ++i) splats[i].store(0.0, std::memory_order_relaxed);
+    }
+
+    Film() = default;
+    Film(Film&&) = default;
+    Film& operator=(Film&&) = default;
+
+    // Pixel p's radiance: the filtered samples, plus any splats. Negative
+    // filter lobes (Mitchell) can push sums below zero, they clamp to black.
+    Vec3 resolve(size_t p) const {
+        const FilmPixel& px = pixels[p];
+        Vec3 c(0,0,0);
+        if (px.weight > 0.0) {
+            const double inv = 1.0 / px.weight;
+            c = Vec3(px.r * inv, px.g * inv, px.b * inv);
+        }
+        const Vec3 s = splat_value(p);
+        if (s.x != 0 || s.y != 0 || s.z != 0) c += splat_scale * s;
+        return Vec3(std::max<Real>(c.x, 0), std::max<Real>(c.y, 0), std::max<Real>(c.z, 0));
+    }
+
+    // Adds radiance at continuous image position (x, y) (pixels, y down),
+    // spread by the filter; safe from any thread at any time
+    void splat(double x, double y, const Vec3& L, const Filter& filter) {
+        const int px = std::min(width - 1, std::max(0, int(x))), py = std::min(height - 1, std::max(0, int(y)));
+        double wx[2 * MAX_MARGIN + 1], wy[2 * MAX_MARGIN + 1];
+        filter.weights(x - px - 0.5, wx);
+        filter.weights(y - py - 0.5, wy);
+        const double norm = 1.0 / filter.integral;
+        for (int l = -filter.margin; l <= filter.margin; ++l) {
+            const int yy = py + l;
+            if (yy < 0 || yy >= height || wy[l + filter.margin] == 0.0) continue;
+            for (int k = -filter.margin; k <= filter.margin; ++k) {
+                const int xx = px + k;
+                const double w = wx[k + filter.margin] * wy[l + filter.margin] * norm;
+                if (xx < 0 || xx >= width || w == 0.0) continue;
+                std::atomic<double>* s = &splats[(size_t(yy) * width + xx) * 3];
+                atomic_add(s[0], w * L.x);
+                atomic_add(s[1], w * L.y);
+                atomic_add(s[2], w * L.z);
+            }
+        }
+    }
+
+    Vec3 splat_value(size_t p) const {
+        return Vec3(splats[3 * p].load(std::memory_order_relaxed), splats[3 * p + 1].load(std::memory_order_relaxed),
+                    splats[3 * p + 2].load(std::memory_order_relaxed));
+    }
+    void set_splat(size_t p, const Vec3& v) {
+        splats[3 * p].store(v.x, std::memory_order_relaxed);
+        splats[3 * p + 1].store(v.y, std::memory_order_relaxed);
+        splats[3 * p + 2].store(v.z, std::memory_order_relaxed);
+    }
+
+    // Adds what the pass's tiles left for their neighbours' pixels, in tile
+    // order; bands of rows run in parallel on the pool (serial without one)
+    inline void merge_aprons(std::vector<FilmTile>& tiles, WorkStealingPool* pool);
+
+    static constexpr int MAX_MARGIN = 4;
+
+private:
+    std::unique_ptr<std::atomic<double>[]> splats;
+
+    static void atomic_add(std::atomic<double>& a, double v) {
+        double old = a.load(std::memory_order_relaxed);
+        while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) {}
+    }
+};
+
+// One tile's private film while it renders: its own pixels, loaded from the
+// film and written straight back (no other tile touches them during the
+// pass), and an apron `margin` pixels wide for the samples its filter
+// spreads into the neighbours, merged by Film::merge_aprons() afterwards.
+// Nothing is shared, so tiles never lock or wait on each other.
+class FilmTile {
+public:
+    // Starts the tile's part of a pass
+    void begin(const Film& film, const Tile& t, const Filter& f) {
+        tile = t;
+        filter = &f;
+        m = f.margin;
+        x0 = t.x0 - m; y0 = t.y0 - m;
+        w = (t.x1 - t.x0) + 2 * m;
+        h = (t.y1 - t.y0) + 2 * m;
+        pixels.assign(size_t(w) * h, FilmPixel());
+        for (int y = t.y0; y < t.y1; ++y)
+            for (int x = t.x0; x < t.x1; ++x) pixels[local(x, y)] = film.pixels[size_t(y) * film.width + x];
+        active = true;
+    }
+
+    // A sample taken in image pixel (x, y), at `ox`, `oy` in [-0.5, 0.5]
+    // from its centre (image axes, y down)
+    void add(int x, int y, double ox, double oy, const Vec3& L) {
+        if (m == 0) {
+            FilmPixel& px = pixels[local(x, y)];
+            px.r += L.x; px.g += L.y; px.b += L.z;
+            px.weight += 1.0;
+            return;
+        }
+        double wx[2 * Film::MAX_MARGIN + 1], wy[2 * Film::MAX_MARGIN + 1];
+        filter->weights(ox, wx);
+        filter->weights(oy, wy);
+        for (int l = -m; l <= m; ++l) {
+            if (wy[l + m] == 0.0) continue;
+            FilmPixel* row = &pixels[local(x - m, y + l)];
+            for (int k = -m; k <= m; ++k) {
+                const double wt = wx[k + m] * wy[l + m];
+                FilmPixel& px = row[k + m];
+                px.r += wt * L.x; px.g += wt * L.y; px.b += wt * L.z;
+                px.weight += wt;
+            }
+        }
+    }
+
+    // Writes the tile's own pixels back
+    void commit(Film& film) const {
+        for (int y = tile.y0; y < tile.y1; ++y)
+            for (int x = tile.x0; x < tile.x1; ++x) film.pixels[size_t(y) * film.width + x] = pixels[local(x, y)];
+    }
+
+    bool active = false;   // rendered in the current pass; its apron awaits merging
+
+private:
+    friend class Film;
+    Tile tile{};
+    const Filter* filter = nullptr;
+    int m = 0, x0 = 0, y0 = 0, w = 0, h = 0;
+    std::vector<FilmPixel> pixels;
+
+    size_t local(int x, int y) const { return size_t(y - y0) * w + (x - x0); }
+};
+
+inline void Film::merge_aprons(std::vector<FilmTile>& tiles, WorkStealingPool* pool) {
+    static const int ROWS_PER_TASK = 16;
+    const size_t tasks = size_t(height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    auto task = [&](size_t t, unsigned) {
+        const int band0 = int(t) * ROWS_PER_TASK, band1 = std::min(height, band0 + ROWS_PER_TASK);
+        for (const FilmTile& ft : tiles) {
+            if (!ft.active || ft.m == 0) continue;
+            const int ya = std::max(band0, std::max(0, ft.y0)), yb = std::min(band1, std::min(height, ft.y0 + ft.h));
+            for (int y = ya; y < yb; ++y) {
+                const bool own_row = y >= ft.tile.y0 && y < ft.tile.y1;
+                const int xa = std::max(0, ft.x0), xb = std::min(width, ft.x0 + ft.w);
+                for (int x = xa; x < xb; ++x) {
+                    if (own_row && x >= ft.tile.x0 && x < ft.tile.x1) continue;
+                    const FilmPixel& s = ft.pixels[ft.local(x, y)];
+                    FilmPixel& d = pixels[size_t(y) * width + x];
+                    d.r += s.r; d.g += s.g; d.b += s.b;
+                    d.weight += s.weight;
+                }
+            }
+        }
+    };
+    if (pool) pool->run(tasks, task);
+    else for (size_t t = 0; t < tasks; ++t) task(t, 0);
+    for (FilmTile& ft : tiles) ft.active = false;
+}
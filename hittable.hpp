@@ -1,16 +1,46 @@
 #pragma once
-#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include "ray.hpp"
 #include "aabb.hpp"
+#include "simd.hpp"
 
-class Material; // forward declaration
+// Index into the owning Scene's material table
+using MaterialId = uint32_t;
+
+// HitRecord::light for surfaces that are not in the scene's light list
+static constexpr uint32_t NO_LIGHT = 0xffffffffu;
+
+// Rounding-error budget of a computed hit point, in units of Real epsilon
+// times the magnitude of the terms that produced it
+constexpr Real HIT_ERROR_ULPS = 32;
+
+// Shadow rays stop this fraction short of the light point they aim at (see
+// spawn_ray_to), so the emitter itself never counts as a blocker
+constexpr Real SHADOW_EPSILON = Real(1e-4);
 
 struct HitRecord {
     Vec3 point;
     Vec3 normal;
-    double t;
+    Real t;
+    Real error;      // bound on |point - true surface point| per axis
     bool front_face;
-    std::shared_ptr<Material> mat;
+    MaterialId mat;
+    uint32_t light;  // index into the scene's light list, or NO_LIGHT
+
+    // Sets t and point = r.at(t), with the error bound of that evaluation
+    inline void set_point(const Ray& r, Real hit_t){
+        t = hit_t;
+        point = r.at(hit_t);
+        error = HIT_ERROR_ULPS * std::numeric_limits<Real>::epsilon() *
+                (max_abs(r.origin) + std::fabs(hit_t) * max_abs(r.direction));
+    }
+
+    static Real max_abs(const Vec3& v){
+        return std::max(std::fabs(v.x), std::max(std::fabs(v.y), std::fabs(v.z)));
+    }
 
     inline void set_face_normal(const Ray& r, const Vec3& outward_normal){
         front_face = dot(r.direction, outward_normal) < 0;
@@ -18,9 +48,88 @@ struct HitRecord {
     }
 };
 
+// Ray leaving the surface of `rec` in direction w. The origin is pushed off
+// the surface along the normal, to the side w points to, by the hit's error
+// bound, so it cannot re-hit the surface it starts on. Unlike a fixed t_min
+// this scales with the scene's coordinates and with the precision of Real.
+inline Ray spawn_ray(const HitRecord& rec, const Vec3& w, Real time = 0){
+    Real d = rec.error * (std::fabs(rec.normal.x) + std::fabs(rec.normal.y) + std::fabs(rec.normal.z));
+    Vec3 offset = dot(w, rec.normal) < 0 ? -d * rec.normal : d * rec.normal;
+    // Round away from the surface, so the addition cannot land back on it
+    auto away = [](Real p, Real off){
+        const Real inf = std::numeric_limits<Real>::infinity();
+        return off > 0 ? std::nextafter(p, inf) : off < 0 ? std::nextafter(p, -inf) : p;
+    };
+    Vec3 o = rec.point + offset;
+    return Ray(Vec3(away(o.x, offset.x), away(o.y, offset.y), away(o.z, offset.z)), w, time);
+}
+
+// Ray from the surface of `rec` to `target`, scaled so t = 1 lands on it.
+// Shadow rays test (0, 1 - SHADOW_EPSILON) and so stop just short of the
+// target however far the origin was pushed.
+inline Ray spawn_ray_to(const HitRecord& rec, const Vec3& target, Real time = 0){
+    Ray r = spawn_ray(rec, target - rec.point, time);
+    r.direction = target - r.origin;
+    return r;
+}
+
+// Ray times run over the camera shutter, [SHUTTER_OPEN, SHUTTER_CLOSE].
+// Motion-aware BVH nodes store their bounds at both ends and interpolate.
+constexpr Real SHUTTER_OPEN  = 0;
+constexpr Real SHUTTER_CLOSE = 1;
+
+// A batch of rays traced together: lane k is rays[k] and is live when bit k
+// of `mask` is set. `size` (4, 8 or 16) is the number of lanes.
+struct PacketQuery {
+    const Ray* rays;
+    uint32_t mask;
+    int size;
+    Real t_min;
+    SimdLevel simd;  // box-test kernels for packet traversal
+    bool frustum;    // coherent primary rays: cull whole nodes by interval arithmetic
+};
+
 class Hittable {
 public:
-    virtual bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const = 0;
-    virtual bool bounding_box(AABB& out_box) const = 0;
+    virtual bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const = 0;
+    virtual bool bounding_box(AABB& out_box) const = 0;   // over the whole shutter
+
+    // Moving primitives report their bounds at shutter open and close; they
+    // must contain the primitive at any time in between when interpolated
+    // linearly. Static ones use the defaults.
+    virtual bool moves() const { return false; }
+    virtual bool motion_bounds(AABB& open, AABB& close) const {
+        bool ok = bounding_box(open);
+        close = open;
+        return ok;
+    }
+
+    // Any-hit query for shadow rays: true if anything blocks (t_min, t_max).
+    // Stops at the first intersection and writes no hit data.
+    virtual bool occluded(const Ray& r, Real t_min, Real t_max) const {
+        HitRecord rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
+    // Packet forms of hit/occluded over the live lanes of `q`. hit_lanes
+    // shrinks t_max[k] and fills rec[k] for each lane it hits and returns
+    // those lanes; occluded_lanes returns the blocked lanes. The defaults
+    // trace one lane at a time; meshes override them with packet traversal.
+    virtual uint32_t hit_lanes(const PacketQuery& q, Real* t_max, HitRecord* rec) const {
+        uint32_t hits = 0;
+        for (int k = 0; k < q.size; ++k) {
+            if (!(q.mask >> k & 1u) || !hit(q.rays[k], q.t_min, t_max[k], rec[k])) continue;
+            t_max[k] = rec[k].t;
+            hits |= 1u << k;
+        }
+        return hits;
+    }
+
+    virtual uint32_t occluded_lanes(const PacketQuery& q, const Real* t_max) const {
+        uint32_t blocked = 0;
+        for (int k = 0; k < q.size; ++k)
+            if ((q.mask >> k & 1u) && occluded(q.rays[k], q.t_min, t_max[k])) blocked |= 1u << k;
+        return blocked;
+    }
     virtual ~Hittable() = default;
 };
@@ -1,35 +1,41 @@
 #pragma once
-#include <memory>
 #include <vector>
 #include "hittable.hpp"
 
+// Non-owning list of objects; the Scene owns them
 class HittableList : public Hittable {
 public:
-    std::vector<std::shared_ptr<Hittable>> objects;
+    std::vector<const Hittable*> objects;
 
     void clear() { objects.clear(); }
-    void add(std::shared_ptr<Hittable> obj) { objects.push_back(std::move(obj)); }
+    void add(const Hittable* obj) { objects.push_back(obj); }
 
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
-        HitRecord temp_rec;
+    // Primitives only write rec on a hit closer than t_max, so it can be
+    // passed straight through
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
         bool hit_anything = false;
-        double closest_so_far = t_max;
+        Real closest_so_far = t_max;
 
-        for (const auto& obj : objects) {
-            if (obj->hit(r, t_min, closest_so_far, temp_rec)) {
+        for (const Hittable* obj : objects) {
+            if (obj->hit(r, t_min, closest_so_far, rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = rec.t;
             }
         }
         return hit_anything;
     }
 
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        for (const Hittable* obj : objects)
+            if (obj->occluded(r, t_min, t_max)) return true;
+        return false;
+    }
+
     bool bounding_box(AABB& out_box) const override {
         if (objects.empty()) return false;
         AABB temp;
         bool first = true;
-        for (const auto& o : objects) {
+        for (const Hittable* o : objects) {
             if (!o->bounding_box(temp)) return false;
             out_box = first ? temp : surrounding_box(out_box, temp);
             first = false;
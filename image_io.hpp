@@ -0,0 +1,360 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Linear HDR film: mean radiance per pixel as interleaved RGB floats, top
+// row first, before exposure and tone mapping
+struct HdrImage {
+    int width = 0, height = 0;
+    std::vector<float> rgb;
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        rgb.resize(size_t(w) * h * 3);
+    }
+    float* row(int y) { return &rgb[size_t(y) * width * 3]; }
+    const float* row(int y) const { return &rgb[size_t(y) * width * 3]; }
+};
+
+enum class HdrFormat { None, PFM, EXR };
+
+inline bool parse_hdr_format(const std::string& s, HdrFormat& out) {
+    if      (s == "none") out = HdrFormat::None;
+    else if (s == "pfm")  out = HdrFormat::PFM;
+    else if (s == "exr")  out = HdrFormat::EXR;
+    else return false;
+    return true;
+}
+
+inline const char* hdr_extension(HdrFormat f) { return f == HdrFormat::EXR ? ".exr" : ".pfm"; }
+
+// `path` with its extension (if any) replaced by `ext`
+inline std::string replace_extension(const std::string& path, const char* ext) {
+    const size_t dot = path.find_last_of('.'), slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + ext;
+    return path.substr(0, dot) + ext;
+}
+
+inline bool write_ppm(const std::string& path, int width, int height, const unsigned char* rgb) {
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb), std::streamsize(size_t(width) * height * 3));
+    if (!file) std::cerr << "cannot write " << path << "\n";
+    return bool(file);
+}
+
+// ----------------------------------------------------------------- PFM
+// Portable float map: text header, then raw float rows bottom to top. A
+// negative scale marks little-endian data.
+
+inline bool host_little_endian() {
+    const uint32_t one = 1;
+    unsigned char b;
+    std::memcpy(&b, &one, 1);
+    return b == 1;
+}
+
+inline uint32_t byte_swap(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+}
+
+inline bool write_pfm(const std::string& path, const HdrImage& img) {
+    std::ofstream file(path, std::ios::binary);
+    file << "PF\n" << img.width << " " << img.height << "\n" << (host_little_endian() ? "-1.0" : "1.0") << "\n";
+    for (int y = img.height - 1; y >= 0; --y)
+        file.write(reinterpret_cast<const char*>(img.row(y)), std::streamsize(size_t(img.width) * 3 * sizeof(float)));
+    if (!file) std::cerr << "cannot write " << path << "\n";
+    return bool(file);
+}
+
+inline bool read_pfm(const std::string& path, HdrImage& img) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { std::cerr << "cannot open " << path << "\n"; return false; }
+    std::string magic;
+    int w = 0, h = 0;
+    double scale = 0.0;
+    file >> magic >> w >> h >> scale;
+    file.get();   // the single whitespace byte before the data
+    if (!file || magic != "PF" || w <= 0 || h <= 0 || scale == 0.0) {
+        std::cerr << path << ": not an RGB PFM file\n";
+        return false;
+    }
+    img.resize(w, h);
+    for (int y = h - 1; y >= 0; --y)
+        file.read(reinterpret_cast<char*>(img.row(y)), std::streamsize(size_t(w) * 3 * sizeof(float)));
+    if (!file) { std::cerr << path << ": truncated\n"; return false; }
+    if ((scale < 0) != host_little_endian())
+        for (float& f : img.rgb) {
+            uint32_t v;
+            std::memcpy(&v, &f, 4);
+            v = byte_swap(v);
+            std::memcpy(&f, &v, 4);
+        }
+    return true;
+}
+
+// ----------------------------------------------------------------- EXR
+// The subset of OpenEXR this renderer needs: single-part scanline files,
+// uncompressed, one line per block. Written as B, G, R FLOAT channels;
+// reading takes HALF or FLOAT R, G and B, so files re-saved by other tools
+// without compression load too. All fields are little-endian.
+
+namespace exr {
+
+inline void put_u32(std::string& s, uint32_t v) { for (int i = 0; i < 4; ++i) s += char((v >> (8 * i)) & 0xFF); }
+inline void put_u64(std::string& s, uint64_t v) { for (int i = 0; i < 8; ++i) s += char((v >> (8 * i)) & 0xFF); }
+inline void put_f32(std::string& s, float f) { uint32_t v; std::memcpy(&v, &f, 4); put_u32(s, v); }
+
+inline uint32_t get_u32(const unsigned char* p) { return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24; }
+inline uint64_t get_u64(const unsigned char* p) { return get_u32(p) | uint64_t(get_u32(p + 4)) << 32; }
+
+inline void attribute(std::string& s, const char* name, const char* type, const std::string& value) {
+    s += name; s += '\0';
+    s += type; s += '\0';
+    put_u32(s, uint32_t(value.size()));
+    s += value;
+}
+
+inline float half_to_float(uint16_t h) {
+    const uint32_t sign = uint32_t(h & 0x8000u) << 16, exp = (h >> 10) & 0x1F, mant = h & 0x3FFu;
+    uint32_t bits;
+    if (exp == 0x1F)   bits = sign | 0x7F800000u | (mant << 13);                 // inf / nan
+    else if (exp != 0) bits = sign | ((exp + 112) << 23) | (mant << 13);
+    else if (mant == 0) bits = sign;
+    else {                                                                       // subnormal
+        int e = -1;
+        uint32_t m = mant;
+        do { ++e; m <<= 1; } while (!(m & 0x400u));
+        bits = sign | uint32_t(112 - e) << 23 | ((m & 0x3FFu) << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, 4);
+    return f;
+}
+
+} // namespace exr
+
+inline bool write_exr(const std::string& path, const HdrImage& img) {
+    std::string head("\x76\x2f\x31\x01", 4);
+    exr::put_u32(head, 2);   // version 2, single-part scanline
+
+    std::string channels;
+    for (const char* c : {"B", "G", "R"}) {   // channel lists are sorted by name
+        channels += c; channels += '\0';
+        exr::put_u32(channels, 2);            // FLOAT
+        exr::put_u32(channels, 0);            // pLinear + reserved
+        exr::put_u32(channels, 1);            // x and y sampling
+        exr::put_u32(channels, 1);
+    }
+    channels += '\0';
+    std::string window;
+    for (uint32_t v : {0u, 0u, uint32_t(img.width - 1), uint32_t(img.height - 1)}) exr::put_u32(window, v);
+    std::string aspect, center, screen_width;
+    exr::put_f32(aspect, 1.0f);
+    exr::put_f32(center, 0.0f); exr::put_f32(center, 0.0f);
+    exr::put_f32(screen_width, 1.0f);
+
+    exr::attribute(head, "channels", "chlist", channels);
+    exr::attribute(head, "compression", "compression", std::string(1, '\0'));
+    exr::attribute(head, "dataWindow", "box2i", window);
+    exr::attribute(head, "displayWindow", "box2i", window);
+    exr::attribute(head, "lineOrder", "lineOrder", std::string(1, '\0'));
+    exr::attribute(head, "pixelAspectRatio", "float", aspect);
+    exr::attribute(head, "screenWindowCenter", "v2f", center);
+    exr::attribute(head, "screenWindowWidth", "float", screen_width);
+    head += '\0';
+
+    // Offset table, then one block per line: y, byte count, the line's B, G
+    // and R values
+    const uint64_t line_bytes = uint64_t(img.width) * 3 * 4;
+    const uint64_t first_block = head.size() + uint64_t(img.height) * 8;
+    for (int y = 0; y < img.height; ++y) exr::put_u64(head, first_block + uint64_t(y) * (8 + line_bytes));
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(head.data(), std::streamsize(head.size()));
+    std::string block;
+    for (int y = 0; y < img.height; ++y) {
+        block.clear();
+        exr::put_u32(block, uint32_t(y));
+        exr::put_u32(block, uint32_t(line_bytes));
+        const float* row = img.row(y);
+        for (int c = 2; c >= 0; --c)
+            for (int x = 0; x < img.width; ++x) exr::put_f32(block, row[3 * x + c]);
+        file.write(block.data(), std::streamsize(block.size()));
+    }
+    if (!file) std::cerr << "cannot write " << path << "\n";
+    return bool(file);
+}
+
+inline bool read_exr(const std::string& path, HdrImage& img) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { std::cerr << "cannot open " << path << "\n"; return false; }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto fail = [&](const char* why){ std::cerr << path << ": " << why << "\n"; return false; };
+    if (data.size() < 8 || exr::get_u32(&data[0]) != 20000630u) return fail("not an OpenEXR file");
+    if ((exr::get_u32(&data[4]) & ~0xFFu) != 0) return fail("only single-part scanline EXR files are supported");
+
+    struct Channel { std::string name; uint32_t type; };
+    std::vector<Channel> channels;
+    int32_t box[4] = {0, 0, -1, -1};
+    int compression = -1;
+    size_t at = 8;
+    auto read_string = [&](std::string& out){
+        size_t end = at;
+        while (end < data.size() && data[end]) ++end;
+        if (end >= data.size()) return false;
+        out.assign(reinterpret_cast<const char*>(&data[at]), end - at);
+        at = end + 1;
+        return true;
+    };
+    for (;;) {
+        std::string name, type;
+        if (!read_string(name)) return fail("truncated header");
+        if (name.empty()) break;
+        if (!read_string(type) || at + 4 > data.size()) return fail("truncated header");
+        const size_t size = exr::get_u32(&data[at]);
+        at += 4;
+        if (at + size > data.size()) return fail("truncated header");
+        const unsigned char* v = &data[at];
+        if (name == "channels") {
+            size_t c = 0;
+            while (c < size && v[c]) {
+                Channel ch;
+                while (c < size && v[c]) ch.name += char(v[c++]);
+                if (c + 17 > size) return fail("bad channel list");
+                ch.type = exr::get_u32(v + c + 1);
+                if (exr::get_u32(v + c + 9) != 1 || exr::get_u32(v + c + 13) != 1) return fail("subsampled channels are not supported");
+                channels.push_back(ch);
+                c += 17;
+            }
+        }
+        else if (name == "compression" && size >= 1) compression = v[0];
+        else if (name == "dataWindow" && size >= 16)
+            for (int i = 0; i < 4; ++i) box[i] = int32_t(exr::get_u32(v + 4 * i));
+        at += size;
+    }
+    if (compression != 0) return fail("only uncompressed EXR files are supported");
+    const int w = box[2] - box[0] + 1, h = box[3] - box[1] + 1;
+    if (w <= 0 || h <= 0) return fail("empty data window");
+
+    // Byte offset of each channel within a line, and which of R, G, B it is
+    size_t line_bytes = 0;
+    std::vector<size_t> offset(channels.size());
+    int found = 0;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        if (channels[c].type != 1 && channels[c].type != 2) return fail("only HALF and FLOAT channels are supported");
+        offset[c] = line_bytes;
+        line_bytes += size_t(w) * (channels[c].type == 1 ? 2 : 4);
+        if (channels[c].name == "R" || channels[c].name == "G" || channels[c].name == "B") ++found;
+    }
+    if (found != 3) return fail("no R, G and B channels");
+
+    img.resize(w, h);
+    if (at + size_t(h) * 8 > data.size()) return fail("truncated offset table");
+    for (int line = 0; line < h; ++line) {
+        const uint64_t block = exr::get_u64(&data[at + size_t(line) * 8]);
+        if (block + 8 + line_bytes > data.size()) return fail("truncated");
+        const int y = int32_t(exr::get_u32(&data[block])) - box[1];
+        if (y < 0 || y >= h || exr::get_u32(&data[block + 4]) != line_bytes) return fail("bad scanline block");
+        const unsigned char* px = &data[block + 8];
+        for (size_t c = 0; c < channels.size(); ++c) {
+            const int k = channels[c].name == "R" ? 0 : channels[c].name == "G" ? 1 : channels[c].name == "B" ? 2 : -1;
+            if (k < 0) continue;
+            float* row = img.row(y);
+            for (int x = 0; x < w; ++x) {
+                if (channels[c].type == 2) {
+                    const uint32_t bits = exr::get_u32(px + offset[c] + 4 * size_t(x));
+                    std::memcpy(&row[3 * x + k], &bits, 4);
+                } else {
+                    const unsigned char* b = px + offset[c] + 2 * size_t(x);
+                    row[3 * x + k] = exr::half_to_float(uint16_t(b[0] | b[1] << 8));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+inline bool read_hdr(const std::string& path, HdrImage& img) {
+    const bool exr = path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0;
+    return exr ? read_exr(path, img) : read_pfm(path, img);
+}
+
+inline bool write_hdr(const std::string& path, const HdrImage& img, HdrFormat format) {
+    return format == HdrFormat::EXR ? write_exr(path, img) : write_pfm(path, img);
+}
+
+// Runs file writes on one background thread, so encoding and I/O overlap
+// with rendering the next pass or frame. Jobs own their buffers and run in
+// submission order; at most `depth` wait at a time, submit() blocks beyond
+// that so a slow disk cannot pile up frames in memory.
+class AsyncWriter {
+public:
+    explicit AsyncWriter(size_t depth = 2) : depth(depth), thread([this]{ loop(); }) {}
+
+    ~AsyncWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void submit(std::function<bool()> job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]{ return jobs.size() < depth; });
+        jobs.push_back(std::move(job));
+        changed.notify_all();
+    }
+
+    // Blocks until every submitted job has run; false if any of them failed
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]{ return jobs.empty() && !busy; });
+        const bool ok = !failed;
+        failed = false;
+        return ok;
+    }
+
+private:
+    size_t depth;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::function<bool()>> jobs;
+    bool busy = false, failed = false, stop = false;
+    std::thread thread;
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [this]{ return stop || !jobs.empty(); });
+            if (jobs.empty()) return;
+            std::function<bool()> job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+            changed.notify_all();
+            lock.unlock();
+            const bool ok = job();
+            lock.lock();
+            busy = false;
+            failed |= !ok;
+            changed.notify_all();
+        }
+    }
+};
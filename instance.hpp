@@ -0,0 +1,77 @@
+#pragma once
+#include "hittable.hpp"
+#include "transform.hpp"
+
+// A placed copy of shared geometry. The geometry (typically a TriangleMesh
+// with its own BVH) lives once in the Scene's `geometries`; each instance is
+// a transform plus a pointer to it, so memory grows with unique geometry and
+// not with the number of copies. Instances are what the top-level BVH holds:
+// rays enter object space at the instance, traverse the bottom-level BVH and
+// the hit comes back out in world space.
+class Instance : public Hittable {
+public:
+    const Hittable* geometry;
+    Transform xf;
+
+    Instance(const Hittable& g, const Transform& t) : geometry(&g), xf(t) { update_box(); }
+
+    // Call after changing `xf`, before the top level is rebuilt
+    void update_box() {
+        AABB b;
+        has_box = geometry->bounding_box(b);
+        if (has_box) box = xf.box(b);
+    }
+
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        if (!geometry->hit(xf.to_object(r), t_min, t_max, rec)) return false;
+        to_world(rec);
+        return true;
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        return geometry->occluded(xf.to_object(r), t_min, t_max);
+    }
+
+    // Packets are transformed as a whole (an affine map keeps them coherent)
+    // and handed to the geometry's own packet traversal
+    uint32_t hit_lanes(const PacketQuery& q, Real* t_max, HitRecord* rec) const override {
+        Ray local[MAX_LANES];
+        uint32_t got = geometry->hit_lanes(to_object(q, local), t_max, rec);
+        for (int k = 0; k < q.size; ++k)
+            if (got >> k & 1u) to_world(rec[k]);
+        return got;
+    }
+
+    uint32_t occluded_lanes(const PacketQuery& q, const Real* t_max) const override {
+        Ray local[MAX_LANES];
+        return geometry->occluded_lanes(to_object(q, local), t_max);
+    }
+
+    bool bounding_box(AABB& out_box) const override {
+        out_box = box;
+        return has_box;
+    }
+
+private:
+    static constexpr int MAX_LANES = 16;
+
+    AABB box;
+    bool has_box = false;
+
+    PacketQuery to_object(const PacketQuery& q, Ray* local) const {
+        for (int k = 0; k < q.size; ++k)
+            if (q.mask >> k & 1u) local[k] = xf.to_object(q.rays[k]);
+        PacketQuery lq = q;
+        lq.rays = local;
+        return lq;
+    }
+
+    // The object-space error grows with the transform, plus the rounding of
+    // the transform itself
+    void to_world(HitRecord& rec) const {
+        rec.point = xf.point(rec.point);
+        rec.normal = normalize(xf.normal(rec.normal));
+        rec.error = xf.norm() * rec.error + HIT_ERROR_ULPS * std::numeric_limits<Real>::epsilon() *
+                    (HitRecord::max_abs(rec.point) + xf.offset());
+    }
+};
@@ -1,18 +1,13 @@
 #pragma once
-#include "material.hpp"
+#include "hittable.hpp"
 #include "vec3.hpp"
 
-class Lambertian : public Material {
-public:
-    Vec3 albedo;
-    explicit Lambertian(const Vec3& a) : albedo(a) {}
-
-    bool scatter(const Ray&, const HitRecord& rec,
-                 Vec3& attenuation, Ray& scattered) const override {
-        Vec3 scatter_dir = rec.normal + random_unit_vector();
-        if (near_zero(scatter_dir)) scatter_dir = rec.normal;
-        scattered = Ray(rec.point, scatter_dir);
-        attenuation = albedo; // cosine-weighted diffuse => weight collapses to albedo
-        return true;
-    }
-};
+// Ideal diffuse reflection
+inline bool lambertian_scatter(const Vec3& albedo, const Ray& r_in, const HitRecord& rec,
+                               Vec3& attenuation, Ray& scattered, Sampler& sampler) {
+    Vec3 scatter_dir = rec.normal + random_unit_vector(sampler);
+    if (near_zero(scatter_dir)) scatter_dir = rec.normal;
+    scattered = spawn_ray(rec, scatter_dir, r_in.time);
+    attenuation = albedo; // cosine-weighted diffuse => weight collapses to albedo
+    return true;
+}
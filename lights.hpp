@@ -0,0 +1,430 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "aabb.hpp"
+#include "onb.hpp"
+#include "sampler.hpp"
+#include "vec3.hpp"
+
+// ---------- emitters ----------
+
+enum class LightShape : uint8_t { Rect, Triangle, Sphere };
+
+// Result of sampling a light from a shading point
+struct LightSample {
+    Vec3   wi;        // unit direction towards the light
+    double dist;      // distance to the sampled point
+    double pdf;       // solid-angle density of wi
+};
+
+// One emissive surface: a rect (any orientation), a triangle or a sphere.
+// Flat emitters radiate from both faces, like Material::emitted.
+struct Light {
+    LightShape shape;
+    Vec3   p0, e1, e2;   // rect: corner + edges; triangle: vertex + edges; sphere: center in p0
+    Vec3   normal;       // unit normal of flat emitters
+    double radius = 0;   // sphere only
+    double area = 0;
+    Vec3   radiance;     // Le
+    double power = 0;    // scalar flux, for selection
+
+    static Light rect(const Vec3& corner, const Vec3& ea, const Vec3& eb, const Vec3& le) {
+        return flat(LightShape::Rect, corner, ea, eb, cross(ea, eb).length(), le);
+    }
+    static Light triangle(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& le) {
+        return flat(LightShape::Triangle, a, b - a, c - a, 0.5 * cross(b - a, c - a).length(), le);
+    }
+    static Light sphere(const Vec3& center, double r, const Vec3& le) {
+        Light l;
+        l.shape = LightShape::Sphere;
+        l.p0 = center;
+        l.radius = r;
+        l.area = 4.0 * PI * r * r;
+        l.radiance = le;
+        l.power = luminance(le) * PI * l.area;
+        return l;
+    }
+
+    AABB bounds() const {
+        if (shape == LightShape::Sphere) {
+            Vec3 r(radius, radius, radius);
+            return AABB(p0 - r, p0 + r);
+        }
+        Vec3 far = shape == LightShape::Rect ? p0 + e1 + e2 : p0;
+        Vec3 pts[4] = {p0, p0 + e1, p0 + e2, far};
+        Vec3 lo = pts[0], hi = pts[0];
+        for (const Vec3& q : pts) {
+            lo = Vec3(std::min(lo.x, q.x), std::min(lo.y, q.y), std::min(lo.z, q.z));
+            hi = Vec3(std::max(hi.x, q.x), std::max(hi.y, q.y), std::max(hi.z, q.z));
+        }
+        return AABB(lo, hi);
+    }
+
+    Vec3 centroid() const {
+        switch (shape) {
+        case LightShape::Rect:     return p0 + 0.5 * (e1 + e2);
+        case LightShape::Triangle: return p0 + (e1 + e2) / 3.0;
+        case LightShape::Sphere:   return p0;
+        }
+        return p0;
+    }
+
+    // Samples a direction towards the light as seen from p (2 dimensions)
+    bool sample(const Vec3& p, Sampler& sampler, LightSample& out) const {
+        Sample2 uv = sampler.next_2d();
+        double u = uv.u, v = uv.v;
+        if (shape == LightShape::Sphere) return sample_sphere(p, u, v, out);
+
+        Vec3 q;
+        if (shape == LightShape::Rect) {
+            q = p0 + u * e1 + v * e2;
+        } else {
+            double su = std::sqrt(u);
+            q = p0 + (su * (1.0 - v)) * e1 + (su * v) * e2;
+        }
+        Vec3 d = q - p;
+        double dist2 = dot(d, d);
+        if (dist2 <= 1e-12) return false;
+        out.dist = std::sqrt(dist2);
+        out.wi = d / out.dist;
+        out.pdf = pdf_flat(out.wi, dist2);
+        return out.pdf > 0.0;
+    }
+
+    // Solid-angle density of sample() producing wi, given that the ray from
+    // p along wi meets this light at distance dist
+    double pdf(const Vec3& p, const Vec3& wi, double dist) const {
+        if (shape == LightShape::Sphere) return pdf_sphere(p);
+        return pdf_flat(wi, dist * dist);
+    }
+
+    static double luminance(const Vec3& c) { return (c.x + c.y + c.z) / 3.0; }
+
+private:
+    static Light flat(LightShape s, const Vec3& o, const Vec3& a, const Vec3& b, double area, const Vec3& le) {
+        Light l;
+        l.shape = s;
+        l.p0 = o; l.e1 = a; l.e2 = b;
+        l.normal = normalize(cross(a, b));
+        l.area = area;
+        l.radiance = le;
+        l.power = luminance(le) * PI * area * 2.0; // two faces
+        return l;
+    }
+
+    double pdf_flat(const Vec3& wi, double dist2) const {
+        double cos_l = std::fabs(dot(normal, wi));
+        if (cos_l <= 1e-8 || area <= 0.0) return 0.0;
+        return dist2 / (cos_l * area);
+    }
+
+    // Uniform over the cone of directions that see the sphere
+    bool sample_sphere(const Vec3& p, double u, double v, LightSample& out) const {
+        Vec3 d = p0 - p;
+        double dc2 = dot(d, d);
+        if (dc2 <= radius * radius) return false; // inside the light
+        double dc = std::sqrt(dc2);
+        double sin2_max = radius * radius / dc2;
+        double cos_max = std::sqrt(std::max(0.0, 1.0 - sin2_max));
+        double one_minus = sin2_max / (1.0 + cos_max); // 1 - cos_max, stable for small spheres
+
+        double cos_t = 1.0 - u * one_minus;
+        double sin2_t = std::max(0.0, 1.0 - cos_t * cos_t);
+        double phi = 2.0 * PI * v;
+        ONB onb; onb.build_from_w(d);
+        out.wi = onb.local(Vec3(std::cos(phi) * std::sqrt(sin2_t), std::sin(phi) * std::sqrt(sin2_t), cos_t));
+        out.dist = dc * cos_t - std::sqrt(std::max(0.0, radius * radius - dc2 * sin2_t));
+        out.pdf = 1.0 / (2.0 * PI * one_minus);
+        return true;
+    }
+
+    double pdf_sphere(const Vec3& p) const {
+        Vec3 d = p0 - p;
+        double dc2 = dot(d, d);
+        if (dc2 <= radius * radius) return 0.0;
+        double sin2_max = radius * radius / dc2;
+        double cos_max = std::sqrt(std::max(0.0, 1.0 - sin2_max));
+        return 1.0 / (2.0 * PI * (sin2_max / (1.0 + cos_max)));
+    }
+};
+
+// ---------- selection ----------
+
+enum class LightSelect { Power, BVH };
+
+inline bool parse_light_select(const std::string& s, LightSelect& out) {
+    if (s == "power") { out = LightSelect::Power; return true; }
+    if (s == "bvh")   { out = LightSelect::BVH;   return true; }
+    return false;
+}
+
+// Walker/Vose alias table: O(1) sampling of a discrete distribution
+class AliasTable {
+public:
+    void build(const std::vector<double>& weights) {
+        size_t n = weights.size();
+        prob.assign(n, 0.0);
+        alias.assign(n, 0);
+        pmf.assign(n, 0.0);
+        double total = 0.0;
+        for (double w : weights) total += w;
+        if (n == 0) return;
+        if (total <= 0.0) { // no power information: uniform
+            std::fill(pmf.begin(), pmf.end(), 1.0 / double(n));
+        } else {
+            for (size_t i = 0; i < n; ++i) pmf[i] = weights[i] / total;
+        }
+
+        std::vector<uint32_t> small, large;
+        std::vector<double> scaled(n);
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] = pmf[i] * double(n);
+            (scaled[i] < 1.0 ? small : large).push_back(uint32_t(i));
+        }
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(); small.pop_back();
+            uint32_t l = large.back();
+            prob[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) { large.pop_back(); small.push_back(l); }
+        }
+        for (uint32_t i : large) prob[i] = 1.0;
+        for (uint32_t i : small) prob[i] = 1.0; // round-off leftovers
+    }
+
+    size_t size() const { return prob.size(); }
+
+    uint32_t sample(double u, double& out_pmf) const {
+        double x = u * double(prob.size());
+        uint32_t i = std::min(uint32_t(x), uint32_t(prob.size() - 1));
+        uint32_t pick = (x - double(i)) < prob[i] ? i : alias[i];
+        out_pmf = pmf[pick];
+        return pick;
+    }
+
+    double probability(uint32_t i) const { return pmf[i]; }
+
+private:
+    std::vector<double> prob;
+    std::vector<uint32_t> alias;
+    std::vector<double> pmf;
+};
+
+// Light BVH: a binary tree over the lights whose nodes carry total power and
+// a bounding sphere. Selection descends from the root, choosing each child in
+// proportion to an importance estimate for the shading point (power over
+// squared distance, times the best-case cosine at the receiver), so distant
+// and back-facing clusters are rarely picked. Leaves hold a few lights, picked
+// by power. Each light records its root-to-leaf path so its selection
+// probability can be re-evaluated for MIS.
+class LightBVH {
+public:
+    static constexpr uint32_t MAX_LEAF_LIGHTS = 4;
+
+    struct Node {
+        float    center[3]; // bounding sphere
+        float    radius;
+        float    power;
+        uint32_t first;     // interior: left child; leaf: first slot in `order`
+        uint32_t second;    // interior: right child; leaf: light count
+        uint32_t leaf;
+    };
+
+    void build(const std::vector<Light>& lights) {
+        nodes.clear();
+        order.resize(lights.size());
+        paths.assign(lights.size(), Path{0, 0});
+        if (lights.empty()) return;
+        for (size_t i = 0; i < order.size(); ++i) order[i] = uint32_t(i);
+        nodes.reserve(2 * lights.size());
+        AABB box;
+        build_range(lights, 0, order.size(), 0, 0, box);
+    }
+
+    bool empty() const { return nodes.empty(); }
+
+    // Picks a light for point p with surface normal n; false if no light can
+    // contribute
+    bool sample(const Vec3& p, const Vec3& n, double u, const std::vector<Light>& lights,
+                uint32_t& light, double& pmf) const {
+        const float pf[3] = {float(p.x), float(p.y), float(p.z)};
+        const float nf[3] = {float(n.x), float(n.y), float(n.z)};
+        uint32_t cur = 0;
+        pmf = 1.0;
+        while (!nodes[cur].leaf) {
+            const Node& nd = nodes[cur];
+            float i0 = importance(pf, nf, nodes[nd.first]);
+            float i1 = importance(pf, nf, nodes[nd.second]);
+            float sum = i0 + i1;
+            if (!(sum > 0.0f)) return false;
+            // Reuse u for the next level by rescaling the chosen interval
+            double x = u * double(sum);
+            if (x < i0) {
+                u = std::min(x / i0, 1.0 - 1e-12);
+                pmf *= i0 / sum;
+                cur = nd.first;
+            } else {
+                u = std::min((x - i0) / i1, 1.0 - 1e-12);
+                pmf *= i1 / sum;
+                cur = nd.second;
+            }
+        }
+
+        // Within the leaf, by power
+        const Node& leaf = nodes[cur];
+        double target = u * leaf.power;
+        light = order[leaf.first + leaf.second - 1];
+        for (uint32_t i = 0; i < leaf.second; ++i) {
+            uint32_t l = order[leaf.first + i];
+            if (target < lights[l].power) { light = l; break; }
+            target -= lights[l].power;
+        }
+        pmf *= leaf_share(lights, leaf, light);
+        return pmf > 0.0;
+    }
+
+    double probability(const Vec3& p, const Vec3& n, const std::vector<Light>& lights, uint32_t light) const {
+        const float pf[3] = {float(p.x), float(p.y), float(p.z)};
+        const float nf[3] = {float(n.x), float(n.y), float(n.z)};
+        const Path& path = paths[light];
+        uint32_t cur = 0;
+        double pmf = 1.0;
+        for (uint32_t d = 0; d < path.depth; ++d) {
+            const Node& nd = nodes[cur];
+            float i0 = importance(pf, nf, nodes[nd.first]);
+            float i1 = importance(pf, nf, nodes[nd.second]);
+            if (!(i0 + i1 > 0.0f)) return 0.0;
+            bool right = (path.bits >> d) & 1u;
+            pmf *= double(right ? i1 : i0) / (double(i0) + double(i1));
+            cur = right ? nd.second : nd.first;
+        }
+        return pmf * leaf_share(lights, nodes[cur], light);
+    }
+
+private:
+    struct Path { uint64_t bits; uint32_t depth; }; // bit d: child taken at depth d
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order; // light indices, grouped by leaf
+    std::vector<Path> paths;
+
+    static double leaf_share(const std::vector<Light>& lights, const Node& leaf, uint32_t light) {
+        return leaf.power > 0.0f ? lights[light].power / double(leaf.power) : 1.0 / double(leaf.second);
+    }
+
+    // Evaluated in float: it only steers selection, and the exact ratio is
+    // folded into the returned pmf either way
+    static float importance(const float p[3], const float n[3], const Node& node) {
+        float d[3] = {node.center[0] - p[0], node.center[1] - p[1], node.center[2] - p[2]};
+        float dist2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        float r2 = node.radius * node.radius;
+        if (dist2 <= r2) return node.power / r2;
+
+        // Best case, over the bounding sphere, of the receiver cosine:
+        // cos(max(0, theta - theta_b)) with sin(theta_b) = radius / dist
+        float inv_dist = 1.0f / std::sqrt(dist2);
+        float cos_t = (n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) * inv_dist;
+        float sin_b = node.radius * inv_dist;
+        float cos_b = std::sqrt(1.0f - sin_b * sin_b);
+        float cos_bound = 1.0f;
+        if (cos_t < cos_b) {
+            cos_bound = cos_t * cos_b + std::sqrt(std::max(0.0f, 1.0f - cos_t * cos_t)) * sin_b;
+            if (cos_bound <= 0.0f) return 0.0f;
+        }
+        return node.power * cos_bound * inv_dist * inv_dist;
+    }
+
+    void set_node(Node& n, const AABB& box, double power) {
+        Vec3 c = 0.5 * (box.min() + box.max());
+        n.center[0] = float(c.x); n.center[1] = float(c.y); n.center[2] = float(c.z);
+        n.radius = float(std::max(0.5 * (box.max() - box.min()).length(), 1e-6));
+        n.power = float(power);
+    }
+
+    uint32_t build_range(const std::vector<Light>& lights, size_t begin, size_t end,
+                         uint64_t bits, uint32_t depth, AABB& box) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.push_back(Node{});
+        if (end - begin <= MAX_LEAF_LIGHTS) {
+            double power = 0.0;
+            box = lights[order[begin]].bounds();
+            for (size_t i = begin; i < end; ++i) {
+                box = surrounding_box(box, lights[order[i]].bounds());
+                power += lights[order[i]].power;
+                paths[order[i]] = Path{bits, depth};
+            }
+            set_node(nodes[index], box, power);
+            nodes[index].first = uint32_t(begin);
+            nodes[index].second = uint32_t(end - begin);
+            nodes[index].leaf = 1;
+            return index;
+        }
+
+        // Median split on the widest centroid axis keeps the tree balanced
+        Vec3 lo = lights[order[begin]].centroid(), hi = lo;
+        for (size_t i = begin; i < end; ++i) {
+            Vec3 c = lights[order[i]].centroid();
+            lo = Vec3(std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z));
+            hi = Vec3(std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z));
+        }
+        Vec3 ext = hi - lo;
+        int axis = ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2);
+        auto key = [&](uint32_t l) {
+            Vec3 c = lights[l].centroid();
+            return axis == 0 ? c.x : axis == 1 ? c.y : c.z;
+        };
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+        AABB lbox, rbox;
+        uint32_t left  = build_range(lights, begin, mid, bits, depth + 1, lbox);
+        uint32_t right = build_range(lights, mid, end, bits | (uint64_t(1) << depth), depth + 1, rbox);
+        box = surrounding_box(lbox, rbox);
+        set_node(nodes[index], box, double(nodes[left].power) + double(nodes[right].power));
+        nodes[index].first = left;
+        nodes[index].second = right;
+        nodes[index].leaf = 0;
+        return index;
+    }
+};
+
+// All emitters of a scene plus the structure that picks one per sample
+class LightSet {
+public:
+    std::vector<Light> lights;
+    LightSelect select = LightSelect::Power;
+
+    void build(LightSelect how) {
+        select = how;
+        std::vector<double> power(lights.size());
+        for (size_t i = 0; i < lights.size(); ++i) power[i] = lights[i].power;
+        alias.build(power);
+        bvh.build(lights);
+    }
+
+    bool   empty() const { return lights.empty(); }
+    size_t size()  const { return lights.size(); }
+    const Light& operator[](uint32_t i) const { return lights[i]; }
+
+    // Chooses one light for shading point p (normal n) with one sample
+    // dimension; pmf is the probability of that choice
+    bool pick(const Vec3& p, const Vec3& n, double u, uint32_t& light, double& pmf) const {
+        if (select == LightSelect::BVH) return bvh.sample(p, n, u, lights, light, pmf);
+        light = alias.sample(u, pmf);
+        return pmf > 0.0;
+    }
+
+    double pick_pmf(const Vec3& p, const Vec3& n, uint32_t light) const {
+        if (select == LightSelect::BVH) return bvh.probability(p, n, lights, light);
+        return alias.probability(light);
+    }
+
+private:
+    AliasTable alias;
+    LightBVH bvh;
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "hittable.hpp"
+#include "bvh.hpp"
+#include "stats.hpp"
+
+// One 32-byte node of the flattened BVH. Interior nodes store their first
+// child directly after themselves and the second child at `offset`; leaves
+// store their primitives at prims[offset, offset+count).
+struct alignas(32) LinearBVHNode {
+    float    bmin[3];
+    float    bmax[3];
+    uint32_t offset;
+    uint16_t count;  // 0 => interior node
+    uint8_t  axis;   // split axis, for near-child ordering
+    uint8_t  pad;
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must stay 32 bytes");
+
+// Float bounds rounded outward, so the float box always contains the double one
+inline void store_bounds(const AABB& b, float bmin[3], float bmax[3]) {
+    const float inf = std::numeric_limits<float>::infinity();
+    const double lo[3] = {b.min().x, b.min().y, b.min().z};
+    const double hi[3] = {b.max().x, b.max().y, b.max().z};
+    for (int a = 0; a < 3; ++a) {
+        bmin[a] = std::nextafter(float(lo[a]), -inf);
+        bmax[a] = std::nextafter(float(hi[a]),  inf);
+    }
+}
+
+inline AABB load_bounds(const LinearBVHNode& n) {
+    return AABB(Vec3(n.bmin[0], n.bmin[1], n.bmin[2]), Vec3(n.bmax[0], n.bmax[1], n.bmax[2]));
+}
+
+// Bounds of a node at shutter open [0] and close [1], kept beside the nodes
+// of a BVH over moving primitives. The node's own box covers the whole
+// shutter, so traversals that ignore motion (packets) stay correct.
+struct LinearBVHMotion {
+    float bmin[2][3];
+    float bmax[2][3];
+};
+
+// Motion bounds are stored pushed out by a few ulps of their magnitude, so
+// the float lerp in traversal (a couple of ulps of error) never shrinks them
+constexpr float MOTION_PAD = 4.0f * std::numeric_limits<float>::epsilon();
+
+inline void store_motion_bounds(const AABB& open, const AABB& close, float bmin[2][3], float bmax[2][3]) {
+    store_bounds(open,  bmin[0], bmax[0]);
+    store_bounds(close, bmin[1], bmax[1]);
+    for (int a = 0; a < 3; ++a) {
+        float lo = MOTION_PAD * std::max(std::fabs(bmin[0][a]), std::fabs(bmin[1][a]));
+        float hi = MOTION_PAD * std::max(std::fabs(bmax[0][a]), std::fabs(bmax[1][a]));
+        bmin[0][a] -= lo; bmin[1][a] -= lo;
+        bmax[0][a] += hi; bmax[1][a] += hi;
+    }
+}
+
+inline float lerp_bound(float b0, float b1, float a) { return b0 + a * (b1 - b0); }
+
+inline float shutter_fraction(Real time) {
+    return float((time - SHUTTER_OPEN) / (SHUTTER_CLOSE - SHUTTER_OPEN));
+}
+
+// Slab test against float bounds; inv_dir precomputed per ray
+inline bool slab_hit(const float bmin[3], const float bmax[3],
+                     const Vec3& o, const Vec3& inv_dir, Real t_min, Real t_max) {
+    Real tx0 = (bmin[0] - o.x) * inv_dir.x, tx1 = (bmax[0] - o.x) * inv_dir.x;
+    Real ty0 = (bmin[1] - o.y) * inv_dir.y, ty1 = (bmax[1] - o.y) * inv_dir.y;
+    Real tz0 = (bmin[2] - o.z) * inv_dir.z, tz1 = (bmax[2] - o.z) * inv_dir.z;
+    t_min = std::max(t_min, std::max(std::min(tx0, tx1), std::max(std::min(ty0, ty1), std::min(tz0, tz1))));
+    t_max = std::min(t_max, std::min(std::max(tx0, tx1), std::min(std::max(ty0, ty1), std::max(tz0, tz1))));
+    return t_min <= t_max;
+}
+
+// Stack traversal shared by every LinearBVHNode array (root at nodes[0],
+// which must exist). leaf(offset, count, t_max) intersects one leaf,
+// shrinking t_max on a hit, and returns whether it hit anything. AnyHit
+// traversal returns at the first leaf hit and skips near-child ordering.
+// With `motion`, node boxes are interpolated to the ray's time.
+template <bool AnyHit = false, class LeafFn>
+inline bool traverse_linear(const LinearBVHNode* nodes, const Ray& r,
+                            Real t_min, Real& t_max, LeafFn&& leaf,
+                            const LinearBVHMotion* motion = nullptr) {
+    const Vec3 inv_dir(1.0 / r.direction.x, 1.0 / r.direction.y, 1.0 / r.direction.z);
+    const bool dir_neg[3] = {inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0};
+
+    uint32_t stack[64];
+    int sp = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+    RT_STAT(RenderStats& st = thread_stats();)
+
+    while (true) {
+        const LinearBVHNode& n = nodes[current];
+        RT_STAT(++st.nodes_visited;)
+        bool box_hit;
+        if (motion) {
+            const LinearBVHMotion& m = motion[current];
+            const float a = shutter_fraction(r.time);
+            float lo[3], hi[3];
+            for (int k = 0; k < 3; ++k) {
+                lo[k] = lerp_bound(m.bmin[0][k], m.bmin[1][k], a);
+                hi[k] = lerp_bound(m.bmax[0][k], m.bmax[1][k], a);
+            }
+            box_hit = slab_hit(lo, hi, r.origin, inv_dir, t_min, t_max);
+        } else {
+            box_hit = slab_hit(n.bmin, n.bmax, r.origin, inv_dir, t_min, t_max);
+        }
+        if (box_hit) {
+            if (n.count > 0) {
+                RT_STAT(st.prim_tests += n.count;)
+                if (leaf(n.offset, n.count, t_max)) {
+                    if (AnyHit) return true;
+                    hit_anything = true;
+                }
+                if (sp == 0) break;
+                current = stack[--sp];
+            } else if (!AnyHit && dir_neg[n.axis]) {
+                stack[sp++] = current + 1;
+                current = n.offset;
+            } else {
+                stack[sp++] = n.offset;
+                current = current + 1;
+            }
+        } else {
+            if (sp == 0) break;
+            current = stack[--sp];
+        }
+    }
+    return hit_anything;
+}
+
+// Flattens a build tree directly; leaves keep the builder's primitive
+// ranges, so the caller must store primitives in BVHPrimInfo order.
+inline uint32_t flatten_build_tree(const BVHBuildNode& n, std::vector<LinearBVHNode>& nodes) {
+    uint32_t index = uint32_t(nodes.size());
+    nodes.emplace_back();
+    store_bounds(n.box, nodes[index].bmin, nodes[index].bmax);
+    nodes[index].axis = uint8_t(n.axis);
+    nodes[index].pad = 0;
+    if (n.is_leaf()) {
+        nodes[index].offset = n.first;
+        nodes[index].count  = uint16_t(n.count);
+        return index;
+    }
+    nodes[index].count = 0;
+    flatten_build_tree(*n.child[0], nodes);
+    nodes[index].offset = flatten_build_tree(*n.child[1], nodes);
+    return index;
+}
+
+// Pointer-free BVH compiled from a BVHNode tree (or loaded ready-made) into
+// one contiguous array.
+// Traversal is iterative with an explicit stack and visits the nearer child
+// first, based on the sign of the ray direction along the split axis.
+class LinearBVH : public Hittable {
+public:
+    std::vector<LinearBVHNode> nodes;
+    std::vector<const Hittable*> prims;
+    std::vector<LinearBVHMotion> motion; // per node; empty unless some primitive moves
+
+    explicit LinearBVH(const BVHNode& root) {
+        if (root.prims.empty() && !root.left) return; // empty scene
+        flatten(root);
+        root_box = root.box;
+        build_motion();
+    }
+
+    // Adopts already-flattened nodes; leaves index into `ordered`
+    LinearBVH(std::vector<LinearBVHNode> flat, std::vector<const Hittable*> ordered)
+        : nodes(std::move(flat)), prims(std::move(ordered)) {
+        if (!nodes.empty()) root_box = load_bounds(nodes[0]);
+        build_motion();
+    }
+
+    const LinearBVHMotion* motion_data() const { return motion.empty() ? nullptr : motion.data(); }
+
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        if (nodes.empty()) return false;
+        return traverse_linear(nodes.data(), r, t_min, t_max,
+            [&](uint32_t offset, uint32_t count, Real& t_far) {
+                bool hit_leaf = false;
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (prims[offset + i]->hit(r, t_min, t_far, rec)) {
+                        hit_leaf = true;
+                        t_far = rec.t;
+                    }
+                }
+                return hit_leaf;
+            }, motion_data());
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        if (nodes.empty()) return false;
+        return traverse_linear<true>(nodes.data(), r, t_min, t_max,
+            [&](uint32_t offset, uint32_t count, Real& t_far) {
+                for (uint32_t i = 0; i < count; ++i)
+                    if (prims[offset + i]->occluded(r, t_min, t_far)) return true;
+                return false;
+            }, motion_data());
+    }
+
+    bool bounding_box(AABB& out_box) const override {
+        out_box = root_box;
+        return !nodes.empty();
+    }
+
+    // Refits every node box bottom-up to the primitives' current bounds,
+    // keeping the topology (for animation: O(nodes), no sorting or
+    // binning). Children always follow their parent in the array, so one
+    // reverse sweep sees both children before the node itself.
+    void refit() {
+        if (nodes.empty()) return;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            LinearBVHNode& n = nodes[i];
+            AABB b;
+            if (n.count > 0) {
+                prims[n.offset]->bounding_box(b);
+                for (uint32_t k = 1; k < n.count; ++k) {
+                    AABB pb;
+                    prims[n.offset + k]->bounding_box(pb);
+                    b = surrounding_box(b, pb);
+                }
+                store_bounds(b, n.bmin, n.bmax);
+            } else {
+                const LinearBVHNode& c0 = nodes[i + 1];
+                const LinearBVHNode& c1 = nodes[n.offset];
+                for (int a = 0; a < 3; ++a) {
+                    n.bmin[a] = std::min(c0.bmin[a], c1.bmin[a]);
+                    n.bmax[a] = std::max(c0.bmax[a], c1.bmax[a]);
+                }
+            }
+        }
+        root_box = load_bounds(nodes[0]);
+        build_motion();
+    }
+
+    // Expected cost per ray under the surface area heuristic, normalised by
+    // the root area (the measure BVHBuildStats::sah_cost reports). Refitting
+    // keeps the topology, so this grows as primitives drift from where the
+    // tree was built for them.
+    double sah_cost(const BVHBuildOptions& opts) const {
+        if (nodes.empty()) return 0.0;
+        const double inv_root = 1.0 / std::max(surface_area(load_bounds(nodes[0])), 1e-300);
+        double cost = 0.0;
+        for (const LinearBVHNode& n : nodes) {
+            const double rel = surface_area(load_bounds(n)) * inv_root;
+            cost += n.count > 0 ? rel * opts.intersect_cost * n.count : rel * opts.traversal_cost;
+        }
+        return cost;
+    }
+
+private:
+    AABB root_box;
+
+    // Refits shutter open/close bounds bottom-up over the finished topology
+    void build_motion() {
+        motion.clear();
+        if (std::none_of(prims.begin(), prims.end(), [](const Hittable* p) { return p->moves(); })) return;
+        motion.resize(nodes.size());
+        AABB open, close;
+        refit_motion(0, open, close);
+    }
+
+    void refit_motion(uint32_t i, AABB& open, AABB& close) {
+        const LinearBVHNode& n = nodes[i];
+        if (n.count > 0) {
+            prims[n.offset]->motion_bounds(open, close);
+            for (uint32_t k = 1; k < n.count; ++k) {
+                AABB o, c;
+                prims[n.offset + k]->motion_bounds(o, c);
+                open = surrounding_box(open, o);
+                close = surrounding_box(close, c);
+            }
+        } else {
+            AABB o1, c1, o2, c2;
+            refit_motion(i + 1, o1, c1);
+            refit_motion(n.offset, o2, c2);
+            open = surrounding_box(o1, o2);
+            close = surrounding_box(c1, c2);
+        }
+        store_motion_bounds(open, close, motion[i].bmin, motion[i].bmax);
+    }
+
+    uint32_t flatten(const BVHNode& n) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        store_bounds(n.box, nodes[index].bmin, nodes[index].bmax);
+        nodes[index].axis = uint8_t(n.axis);
+        nodes[index].pad = 0;
+
+        if (!n.prims.empty()) {
+            nodes[index].offset = uint32_t(prims.size());
+            nodes[index].count  = uint16_t(n.prims.size());
+            prims.insert(prims.end(), n.prims.begin(), n.prims.end());
+            return index;
+        }
+
+        nodes[index].count = 0;
+        flatten(*n.left);
+        uint32_t second = flatten(*n.right);
+        nodes[index].offset = second;
+        return index;
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define RT_HAVE_MMAP 0
+#endif
+
+// Read-only view of a whole file: mmap where available, otherwise the file
+// is read into memory once.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#if RT_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+        length = size_t(st.st_size);
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) { ::close(fd); length = 0; return false; }
+            madvise(p, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(p);
+        }
+        ::close(fd);
+        mapped = true;
+        return true;
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return false;
+        fallback.resize(size_t(in.tellg()));
+        in.seekg(0);
+        in.read(fallback.data(), std::streamsize(fallback.size()));
+        bytes = fallback.data();
+        length = fallback.size();
+        mapped = true;
+        return true;
+#endif
+    }
+
+    void close() {
+#if RT_HAVE_MMAP
+        if (bytes && length) munmap(const_cast<char*>(bytes), length);
+#else
+        fallback.clear();
+#endif
+        bytes = nullptr;
+        length = 0;
+        mapped = false;
+    }
+
+    bool        is_open() const { return mapped; }
+    const char* data() const { return bytes; }
+    size_t      size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+#if !RT_HAVE_MMAP
+    std::vector<char> fallback;
+#endif
+};
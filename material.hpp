@@ -1,15 +1,54 @@
 #pragma once
+#include <cstdint>
 #include "ray.hpp"
 #include "hittable.hpp"
+#include "lambertian.hpp"
+#include "metal.hpp"
+#include "dielectric.hpp"
+#include "diffuse_light.hpp"
+
+enum class MaterialType : uint32_t { Lambertian, Metal, Dielectric, DiffuseLight };
+
+// Closed material representation: a type tag plus one packed parameter
+// block, evaluated with a switch. No virtual calls, and materials can be
+// stored, sorted and serialized as plain data.
+struct Material {
+    MaterialType type = MaterialType::Lambertian;
+    Vec3   color;     // albedo (Lambertian, Metal) or emission tint (DiffuseLight)
+    double param = 0; // Metal: fuzz, Dielectric: index of refraction, DiffuseLight: exitance M
+
+    static Material lambertian(const Vec3& albedo)  { return {MaterialType::Lambertian, albedo, 0.0}; }
+    static Material metal(const Vec3& albedo, double fuzz) {
+        return {MaterialType::Metal, albedo, fuzz < 1 ? fuzz : 1};
+    }
+    static Material dielectric(double ir)           { return {MaterialType::Dielectric, Vec3(1, 1, 1), ir}; }
+    static Material diffuse_light(const Vec3& tint, double exitance) {
+        return {MaterialType::DiffuseLight, tint, exitance};
+    }
+
+    // Diffuse surfaces get next-event estimation; `color` is their albedo
+    bool is_diffuse()  const { return type == MaterialType::Lambertian; }
+    bool is_emissive() const { return type == MaterialType::DiffuseLight; }
 
-class Material {
-public:
     // BRDF sampling
-    virtual bool scatter(const Ray& r_in, const HitRecord& rec,
-                         Vec3& attenuation, Ray& scattered) const = 0;
+    bool scatter(const Ray& r_in, const HitRecord& rec,
+                 Vec3& attenuation, Ray& scattered, Sampler& sampler) const {
+        switch (type) {
+        case MaterialType::Lambertian: return lambertian_scatter(color, r_in, rec, attenuation, scattered, sampler);
+        case MaterialType::Metal:      return metal_scatter(color, param, r_in, rec, attenuation, scattered, sampler);
+        case MaterialType::Dielectric: return dielectric_scatter(param, r_in, rec, attenuation, scattered, sampler);
+        case MaterialType::DiffuseLight: return false; // lights don't scatter in this simple model
+        }
+        return false;
+    }
 
-    // Emission (radiance, W·sr^-1·m^-2); default = black
-    virtual Vec3 emitted(const HitRecord& rec) const { return Vec3(0,0,0); }
+    // Reflectance for the denoiser's albedo guide: the surface colour, white
+    // for glass and lights
+    Vec3 albedo() const {
+        return type == MaterialType::Lambertian || type == MaterialType::Metal ? color : Vec3(1, 1, 1);
+    }
 
-    virtual ~Material() = default;
+    // Emission (radiance, W·sr^-1·m^-2); black for everything but lights
+    Vec3 radiance() const { return is_emissive() ? diffuse_light_radiance(color, param) : Vec3(0,0,0); }
+    Vec3 emitted(const HitRecord&) const { return radiance(); }
 };
@@ -0,0 +1,394 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "triangle_mesh.hpp"
+
+// Mesh loading: Wavefront OBJ (positions and faces only) and binary PLY.
+// Files are memory-mapped and parsed in parallel chunks.
+
+namespace mesh_detail {
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+inline const char* next_line(const char* p, const char* end) {
+    const void* nl = std::memchr(p, '\n', size_t(end - p));
+    return nl ? static_cast<const char*>(nl) + 1 : end;
+}
+
+// What one OBJ chunk produced. Negative (relative) face indices can only be
+// resolved once the vertex counts of all earlier chunks are known, so they
+// are remembered and fixed up after the parallel pass.
+struct ObjChunk {
+    std::vector<float> px, py, pz;
+    std::vector<uint32_t> indices;
+    std::vector<size_t> relative; // positions in `indices` that need the chunk's vertex base
+    bool ok = true;
+};
+
+inline void parse_obj_chunk(const char* p, const char* end, ObjChunk& out) {
+    std::vector<std::pair<int64_t, bool>> poly; // (index, relative)
+    while (p < end) {
+        const char* line_end = next_line(p, end);
+        p = skip_spaces(p, line_end);
+        if (line_end - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            char* q;
+            float x = std::strtof(p + 2, &q);
+            float y = std::strtof(q, &q);
+            float z = std::strtof(q, &q);
+            out.px.push_back(x); out.py.push_back(y); out.pz.push_back(z);
+        } else if (line_end - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            poly.clear();
+            const char* q = p + 2;
+            while (true) {
+                q = skip_spaces(q, line_end);
+                if (q >= line_end || *q == '\n') break;
+                char* after;
+                long long idx = std::strtoll(q, &after, 10);
+                if (after == q || idx == 0) { out.ok = false; break; } // OBJ indices start at 1
+                // Relative indices count back from the vertices seen so far
+                // in this chunk (possibly into an earlier chunk); the chunk
+                // base is added later, in wrapping uint32 arithmetic
+                if (idx > 0) poly.push_back({idx - 1, false});
+                else         poly.push_back({int64_t(out.px.size()) + idx, true});
+                q = after;
+                while (q < line_end && *q != ' ' && *q != '\t' && *q != '\n') ++q; // skip /vt/vn
+            }
+            for (size_t k = 1; k + 1 < poly.size(); ++k) { // fan triangulation
+                const std::pair<int64_t, bool> tri[3] = {poly[0], poly[k], poly[k + 1]};
+                for (const auto& v : tri) {
+                    if (v.second) out.relative.push_back(out.indices.size());
+                    out.indices.push_back(uint32_t(v.first));
+                }
+            }
+        }
+        p = line_end;
+    }
+}
+
+enum class PlyType { None, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+inline PlyType ply_type(const std::string& s) {
+    if (s == "char"   || s == "int8")    return PlyType::Int8;
+    if (s == "uchar"  || s == "uint8")   return PlyType::UInt8;
+    if (s == "short"  || s == "int16")   return PlyType::Int16;
+    if (s == "ushort" || s == "uint16")  return PlyType::UInt16;
+    if (s == "int"    || s == "int32")   return PlyType::Int32;
+    if (s == "uint"   || s == "uint32")  return PlyType::UInt32;
+    if (s == "float"  || s == "float32") return PlyType::Float32;
+    if (s == "double" || s == "float64") return PlyType::Float64;
+    return PlyType::None;
+}
+
+inline size_t ply_size(PlyType t) {
+    switch (t) {
+    case PlyType::Int8: case PlyType::UInt8:     return 1;
+    case PlyType::Int16: case PlyType::UInt16:   return 2;
+    case PlyType::Int32: case PlyType::UInt32:
+    case PlyType::Float32:                       return 4;
+    case PlyType::Float64:                       return 8;
+    default:                                     return 0;
+    }
+}
+
+inline double ply_read(const char* p, PlyType t, bool swap) {
+    unsigned char b[8];
+    size_t n = ply_size(t);
+    std::memcpy(b, p, n);
+    if (swap) for (size_t i = 0; i < n / 2; ++i) std::swap(b[i], b[n - 1 - i]);
+    switch (t) {
+    case PlyType::Int8:    { int8_t v;   std::memcpy(&v, b, 1); return v; }
+    case PlyType::UInt8:   { uint8_t v;  std::memcpy(&v, b, 1); return v; }
+    case PlyType::Int16:   { int16_t v;  std::memcpy(&v, b, 2); return v; }
+    case PlyType::UInt16:  { uint16_t v; std::memcpy(&v, b, 2); return v; }
+    case PlyType::Int32:   { int32_t v;  std::memcpy(&v, b, 4); return v; }
+    case PlyType::UInt32:  { uint32_t v; std::memcpy(&v, b, 4); return v; }
+    case PlyType::Float32: { float v;    std::memcpy(&v, b, 4); return v; }
+    case PlyType::Float64: { double v;   std::memcpy(&v, b, 8); return v; }
+    default:               return 0.0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::None;
+    PlyType list_count = PlyType::None; // != None => list property
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> props;
+};
+
+} // namespace mesh_detail
+
+inline bool load_obj(const MappedFile& file, MeshData& mesh) {
+    using namespace mesh_detail;
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Chunk boundaries snapped forward to line starts
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(hw, file.size() / (1 << 20)));
+    std::vector<const char*> cuts(chunks + 1, end);
+    cuts[0] = begin;
+    for (size_t c = 1; c < chunks; ++c)
+        cuts[c] = std::max(cuts[c - 1], next_line(begin + file.size() * c / chunks, end));
+
+    std::vector<ObjChunk> parts(chunks);
+    parallel_chunks(chunks, 1, [&](unsigned, size_t b, size_t e) {
+        for (size_t c = b; c < e; ++c) parse_obj_chunk(cuts[c], cuts[c + 1], parts[c]);
+    });
+
+    size_t verts = 0, idx = 0;
+    for (const auto& part : parts) {
+        if (!part.ok) { std::cerr << "OBJ: malformed face\n"; return false; }
+        verts += part.px.size();
+        idx += part.indices.size();
+    }
+    mesh.px.resize(verts); mesh.py.resize(verts); mesh.pz.resize(verts);
+    mesh.indices.resize(idx);
+
+    std::vector<size_t> vbase(chunks), ibase(chunks);
+    for (size_t c = 1; c < chunks; ++c) {
+        vbase[c] = vbase[c - 1] + parts[c - 1].px.size();
+        ibase[c] = ibase[c - 1] + parts[c - 1].indices.size();
+    }
+    parallel_chunks(chunks, 1, [&](unsigned, size_t b, size_t e) {
+        for (size_t c = b; c < e; ++c) {
+            ObjChunk& part = parts[c];
+            for (size_t pos : part.relative) part.indices[pos] += uint32_t(vbase[c]);
+            std::copy(part.px.begin(), part.px.end(), mesh.px.begin() + vbase[c]);
+            std::copy(part.py.begin(), part.py.end(), mesh.py.begin() + vbase[c]);
+            std::copy(part.pz.begin(), part.pz.end(), mesh.pz.begin() + vbase[c]);
+            std::copy(part.indices.begin(), part.indices.end(), mesh.indices.begin() + ibase[c]);
+        }
+    });
+
+    for (uint32_t v : mesh.indices) {
+        if (v >= verts) { std::cerr << "OBJ: face index out of range\n"; return false; }
+    }
+    return true;
+}
+
+inline bool load_ply(const MappedFile& file, MeshData& mesh) {
+    using namespace mesh_detail;
+    const char* p = file.data();
+    const char* end = p + file.size();
+
+    // ---- header ----
+    std::vector<PlyElement> elements;
+    bool swap = false, header_done = false;
+    {
+        const char* line = p;
+        bool first = true;
+        while (line < end) {
+            const char* le = next_line(line, end);
+            std::string s(line, le);
+            while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+            line = le;
+            if (first) {
+                if (s != "ply") { std::cerr << "PLY: missing magic\n"; return false; }
+                first = false;
+                continue;
+            }
+            std::vector<std::string> tok;
+            size_t a = 0;
+            while (a < s.size()) {
+                size_t b = s.find(' ', a);
+                if (b == std::string::npos) b = s.size();
+                if (b > a) tok.push_back(s.substr(a, b - a));
+                a = b + 1;
+            }
+            if (tok.empty()) continue;
+            if (tok[0] == "format") {
+                if (tok.size() < 2 || tok[1] == "ascii") {
+                    std::cerr << "PLY: only binary PLY is supported\n";
+                    return false;
+                }
+                uint16_t probe = 1;
+                bool host_little = *reinterpret_cast<unsigned char*>(&probe) == 1;
+                swap = (tok[1] == "binary_little_endian") != host_little;
+            } else if (tok[0] == "element" && tok.size() >= 3) {
+                PlyElement el;
+                el.name = tok[1];
+                el.count = size_t(std::strtoull(tok[2].c_str(), nullptr, 10));
+                elements.push_back(el);
+            } else if (tok[0] == "property" && !elements.empty()) {
+                PlyProperty prop;
+                if (tok.size() >= 5 && tok[1] == "list") {
+                    prop.list_count = ply_type(tok[2]);
+                    prop.type = ply_type(tok[3]);
+                    prop.name = tok[4];
+                } else if (tok.size() >= 3) {
+                    prop.type = ply_type(tok[1]);
+                    prop.name = tok[2];
+                }
+                if (prop.type == PlyType::None) { std::cerr << "PLY: unknown property type\n"; return false; }
+                elements.back().props.push_back(prop);
+            } else if (tok[0] == "end_header") {
+                header_done = true;
+                break;
+            }
+        }
+        p = line;
+    }
+    if (!header_done) { std::cerr << "PLY: truncated header\n"; return false; }
+
+    // ---- body ----
+    // Every advance is checked against the bytes left first, so `p` never
+    // passes `end` (and `end - p` never wraps)
+    auto fits = [&](const char* at, size_t count, size_t size) {
+        return size == 0 || count <= size_t(end - at) / size;
+    };
+    for (const PlyElement& el : elements) {
+        bool fixed = true;
+        size_t stride = 0;
+        for (const auto& prop : el.props) {
+            if (prop.list_count != PlyType::None) fixed = false;
+            else stride += ply_size(prop.type);
+        }
+
+        if (el.name == "vertex") {
+            if (!fixed) { std::cerr << "PLY: list properties on vertices are not supported\n"; return false; }
+            if (!fits(p, el.count, stride)) { std::cerr << "PLY: truncated vertex data\n"; return false; }
+            size_t off[3] = {0, 0, 0};
+            PlyType type[3] = {PlyType::None, PlyType::None, PlyType::None};
+            size_t o = 0;
+            for (const auto& prop : el.props) {
+                int axis = prop.name == "x" ? 0 : prop.name == "y" ? 1 : prop.name == "z" ? 2 : -1;
+                if (axis >= 0) { off[axis] = o; type[axis] = prop.type; }
+                o += ply_size(prop.type);
+            }
+            if (type[0] == PlyType::None || type[1] == PlyType::None || type[2] == PlyType::None) {
+                std::cerr << "PLY: vertex element lacks x/y/z\n";
+                return false;
+            }
+            mesh.px.resize(el.count); mesh.py.resize(el.count); mesh.pz.resize(el.count);
+            const char* base = p;
+            parallel_chunks(el.count, 1 << 16, [&](unsigned, size_t b, size_t e) {
+                for (size_t i = b; i < e; ++i) {
+                    const char* v = base + i * stride;
+                    mesh.px[i] = float(ply_read(v + off[0], type[0], swap));
+                    mesh.py[i] = float(ply_read(v + off[1], type[1], swap));
+                    mesh.pz[i] = float(ply_read(v + off[2], type[2], swap));
+                }
+            });
+            p += el.count * stride;
+        } else if (el.name == "face") {
+            // Variable-length records: one cheap serial pass finds where each
+            // face starts and how many triangles it yields, then the decode
+            // runs in parallel.
+            std::vector<size_t> start(el.count), tri_base(el.count + 1, 0);
+            int list_prop = -1;
+            for (size_t k = 0; k < el.props.size(); ++k)
+                if (el.props[k].list_count != PlyType::None &&
+                    (el.props[k].name == "vertex_indices" || el.props[k].name == "vertex_index"))
+                    list_prop = int(k);
+            if (list_prop < 0) { std::cerr << "PLY: face element lacks vertex_indices\n"; return false; }
+
+            if (el.count > size_t(end - p)) { std::cerr << "PLY: truncated face data\n"; return false; }
+            const char* q = p;
+            for (size_t f = 0; f < el.count; ++f) {
+                start[f] = size_t(q - p);
+                size_t tris = 0;
+                for (size_t k = 0; k < el.props.size(); ++k) {
+                    const auto& prop = el.props[k];
+                    if (prop.list_count == PlyType::None) {
+                        if (!fits(q, 1, ply_size(prop.type))) { std::cerr << "PLY: truncated face data\n"; return false; }
+                        q += ply_size(prop.type);
+                        continue;
+                    }
+                    if (!fits(q, 1, ply_size(prop.list_count))) { std::cerr << "PLY: truncated face data\n"; return false; }
+                    size_t n = size_t(ply_read(q, prop.list_count, swap));
+                    q += ply_size(prop.list_count);
+                    if (!fits(q, n, ply_size(prop.type))) { std::cerr << "PLY: truncated face data\n"; return false; }
+                    q += n * ply_size(prop.type);
+                    if (int(k) == list_prop && n >= 3) tris = n - 2;
+                }
+                tri_base[f + 1] = tri_base[f] + tris;
+            }
+
+            mesh.indices.resize(3 * tri_base[el.count]);
+            const char* base = p;
+            parallel_chunks(el.count, 1 << 16, [&](unsigned, size_t b, size_t e) {
+                for (size_t f = b; f < e; ++f) {
+                    const char* r = base + start[f];
+                    size_t out = 3 * tri_base[f];
+                    for (size_t k = 0; k < el.props.size(); ++k) {
+                        const auto& prop = el.props[k];
+                        if (prop.list_count == PlyType::None) { r += ply_size(prop.type); continue; }
+                        size_t n = size_t(ply_read(r, prop.list_count, swap));
+                        r += ply_size(prop.list_count);
+                        if (int(k) == list_prop) {
+                            const size_t es = ply_size(prop.type);
+                            uint32_t v0 = uint32_t(ply_read(r, prop.type, swap));
+                            for (size_t i = 1; i + 1 < n; ++i) { // fan triangulation
+                                mesh.indices[out++] = v0;
+                                mesh.indices[out++] = uint32_t(ply_read(r + i * es, prop.type, swap));
+                                mesh.indices[out++] = uint32_t(ply_read(r + (i + 1) * es, prop.type, swap));
+                            }
+                        }
+                        r += n * ply_size(prop.type);
+                    }
+                }
+            });
+            p = q;
+        } else {
+            // Unknown element: skip it
+            if (fixed) {
+                if (!fits(p, el.count, stride)) { std::cerr << "PLY: truncated file\n"; return false; }
+                p += el.count * stride;
+                continue;
+            }
+            for (size_t i = 0; i < el.count; ++i)
+                for (const auto& prop : el.props) {
+                    const size_t head = ply_size(prop.list_count == PlyType::None ? prop.type : prop.list_count);
+                    if (!fits(p, 1, head)) { std::cerr << "PLY: truncated file\n"; return false; }
+                    if (prop.list_count == PlyType::None) { p += head; continue; }
+                    size_t n = size_t(ply_read(p, prop.list_count, swap));
+                    p += head;
+                    if (!fits(p, n, ply_size(prop.type))) { std::cerr << "PLY: truncated file\n"; return false; }
+                    p += n * ply_size(prop.type);
+                }
+        }
+    }
+
+    for (uint32_t v : mesh.indices) {
+        if (v >= mesh.px.size()) { std::cerr << "PLY: face index out of range\n"; return false; }
+    }
+    return true;
+}
+
+// Loads an .obj or .ply file (chosen by extension); fails on a file with
+// no triangles
+inline bool load_mesh(const std::string& path, MeshData& mesh) {
+    MappedFile file(path);
+    if (!file.is_open()) { std::cerr << "mesh: cannot open " << path << "\n"; return false; }
+
+    auto ends_with = [&](const char* ext) {
+        size_t n = std::strlen(ext);
+        if (path.size() < n) return false;
+        for (size_t i = 0; i < n; ++i)
+            if (std::tolower((unsigned char)path[path.size() - n + i]) != ext[i]) return false;
+        return true;
+    };
+    bool ok;
+    if      (ends_with(".obj")) ok = load_obj(file, mesh);
+    else if (ends_with(".ply")) ok = load_ply(file, mesh);
+    else { std::cerr << "mesh: unsupported file type " << path << "\n"; return false; }
+    // An empty mesh would have no BVH and no bounding box
+    if (ok && mesh.indices.empty()) { std::cerr << "mesh: " << path << " has no triangles\n"; return false; }
+    return ok;
+}
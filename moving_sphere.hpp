@@ -1,46 +1,79 @@
 #pragma once
-#include <memory>
 #include "hittable.hpp"
 
+// Sphere whose centre moves linearly from center0 at time0 to center1 at
+// time1 (and keeps going outside that range)
 class MovingSphere : public Hittable {
 public:
     Vec3 center0, center1;
-    double time0, time1;
-    double radius;
-    std::shared_ptr<Material> mat;
+    Real time0, time1;
+    Real radius;
+    MaterialId mat;
 
     MovingSphere(const Vec3& c0, const Vec3& c1,
-                 double t0, double t1,
-                 double r, std::shared_ptr<Material> m)
-        : center0(c0), center1(c1), time0(t0), time1(t1), radius(r), mat(std::move(m)) {}
+                 Real t0, Real t1,
+                 Real r, MaterialId m)
+        : center0(c0), center1(c1), time0(t0), time1(t1), radius(r), mat(m) {}
 
-    Vec3 center(double time) const {
-        double alpha = (time - time0) / (time1 - time0);
+    Vec3 center(Real time) const {
+        Real alpha = (time - time0) / (time1 - time0);
         return center0 + alpha * (center1 - center0);
     }
 
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
         Vec3 c = center(r.time);
+        Real root;
+        if (!intersect(r, c, t_min, t_max, root)) return false;
+
+        rec.set_point(r, root);
+        // Snap onto the sphere: the quadratic's root can lose digits, this cannot
+        Vec3 outward_normal = normalize(rec.point - c);
+        rec.point = c + radius * outward_normal;
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = mat;
+        rec.light = NO_LIGHT;
+        return true;
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        Real root;
+        return intersect(r, center(r.time), t_min, t_max, root);
+    }
+
+    bool bounding_box(AABB& out_box) const override {
+        AABB open, close;
+        motion_bounds(open, close);
+        out_box = surrounding_box(open, close);
+        return true;
+    }
+
+    bool moves() const override { return true; }
+
+    // Linear motion: the box at any shutter time is the lerp of these two
+    bool motion_bounds(AABB& open, AABB& close) const override {
+        const Vec3 r(radius, radius, radius);
+        Vec3 c0 = center(SHUTTER_OPEN), c1 = center(SHUTTER_CLOSE);
+        open  = AABB(c0 - r, c0 + r);
+        close = AABB(c1 - r, c1 + r);
+        return true;
+    }
+
+private:
+    bool intersect(const Ray& r, const Vec3& c, Real t_min, Real t_max, Real& root) const {
         Vec3 oc = r.origin - c;
-        double a = dot(r.direction, r.direction);
-        double half_b = dot(oc, r.direction);
-        double cc = dot(oc, oc) - radius*radius;
-        double discriminant = half_b*half_b - a*cc;
+        Real a = dot(r.direction, r.direction);
+        Real half_b = dot(oc, r.direction);
+        Real cc = dot(oc, oc) - radius*radius;
+        Real discriminant = half_b*half_b - a*cc;
         if (discriminant < 0) return false;
 
-        double sqrt_d = std::sqrt(discriminant);
+        Real sqrt_d = std::sqrt(discriminant);
 
-        double root = (-half_b - sqrt_d) / a;
+        root = (-half_b - sqrt_d) / a;
         if (root < t_min || root > t_max) {
             root = (-half_b + sqrt_d) / a;
             if (root < t_min || root > t_max) return false;
         }
-
-        rec.t = root;
-        rec.point = r.at(rec.t);
-        Vec3 outward_normal = (rec.point - c) / radius;
-        rec.set_face_normal(r, outward_normal);
-        rec.mat = mat;
         return true;
     }
 };
@@ -14,13 +14,14 @@ struct ONB {
     Vec3 local(const Vec3& a) const { return u*a.x + v*a.y + w*a.z; }
 };
 
-// Cosine-weighted hemisphere sample (pdf = cos(theta)/pi)
-inline Vec3 random_cosine_direction() {
-    double r1 = random_double();
-    double r2 = random_double();
-    double z  = std::sqrt(1 - r2);
-    double phi = 2.0 * PI * r1;
-    double x = std::cos(phi) * std::sqrt(r2);
-    double y = std::sin(phi) * std::sqrt(r2);
+// Cosine-weighted hemisphere sample (pdf = cos(theta)/pi), 2 dimensions
+inline Vec3 random_cosine_direction(Sampler& sampler) {
+    Sample2 s = sampler.next_2d();
+    Real r1 = s.u;
+    Real r2 = s.v;
+    Real z  = std::sqrt(1 - r2);
+    Real phi = 2.0 * PI * r1;
+    Real x = std::cos(phi) * std::sqrt(r2);
+    Real y = std::sin(phi) * std::sqrt(r2);
     return Vec3(x, y, z);
 }
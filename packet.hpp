@@ -0,0 +1,311 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "hittable.hpp"
+#include "linear_bvh.hpp"
+#include "simd.hpp"
+#include "wide_bvh.hpp"
+
+// Ray packets for coherent rays (camera rays of neighbouring pixels, shadow
+// rays toward one light). A packet walks a binary LinearBVH with one shared
+// stack: each node's box is tested against every lane at once with SIMD, and
+// the packet descends while any lane still overlaps. Lanes must share a
+// direction octant, so near-child order is common to all of them; packets
+// that do not are reported incoherent and the caller traces lane by lane.
+
+template <int N>
+struct RayPacket {
+    static_assert(N == 4 || N == 8 || N == 16, "packets have 4, 8 or 16 lanes");
+    static constexpr int lanes = N;
+
+    alignas(32) float o[3][N];
+    alignas(32) float inv[3][N];
+    alignas(32) float t_far[N];   // box-test limit per lane; -inf on dead lanes
+    Real od[3][N], dd[3][N];    // full-precision origin/direction for primitive tests
+    uint32_t live = 0;
+    int  neg[3] = {0, 0, 0};
+    bool coherent = false;        // every live lane shares the octant `neg`
+
+    // Interval bounds over the live lanes, for frustum culling
+    float o_lo[3], o_hi[3], inv_lo[3], inv_hi[3];
+    float t_far_max = 0.0f;
+    bool bounded = false;         // all inverse directions finite
+
+    RayPacket(const PacketQuery& q, const Real* t_max) : live(q.mask) {
+        int first = -1;
+        for (int k = 0; k < N && first < 0; ++k)
+            if (live >> k & 1u) first = k;
+        if (first < 0) return;
+        const Vec3& d0 = q.rays[first].direction;
+        neg[0] = d0.x < 0; neg[1] = d0.y < 0; neg[2] = d0.z < 0;
+        for (int k = first + 1; k < N; ++k) {
+            if (!(live >> k & 1u)) continue;
+            const Vec3& d = q.rays[k].direction;
+            if ((d.x < 0) != bool(neg[0]) || (d.y < 0) != bool(neg[1]) || (d.z < 0) != bool(neg[2])) return;
+        }
+        coherent = true;
+
+        const float inf = std::numeric_limits<float>::infinity();
+        bounded = true;
+        for (int a = 0; a < 3; ++a) { o_lo[a] = inv_lo[a] = inf; o_hi[a] = inv_hi[a] = -inf; }
+        for (int k = 0; k < N; ++k) {
+            if (!(live >> k & 1u)) {
+                for (int a = 0; a < 3; ++a) { o[a][k] = 0.0f; inv[a][k] = 0.0f; od[a][k] = dd[a][k] = 0.0; }
+                t_far[k] = -inf;
+                continue;
+            }
+            const Ray& r = q.rays[k];
+            const Real ro[3] = {r.origin.x, r.origin.y, r.origin.z};
+            const Real rd[3] = {r.direction.x, r.direction.y, r.direction.z};
+            for (int a = 0; a < 3; ++a) {
+                od[a][k] = ro[a];
+                dd[a][k] = rd[a];
+                o[a][k] = float(ro[a]);
+                inv[a][k] = float(1.0 / rd[a]);
+                o_lo[a] = std::min(o_lo[a], o[a][k]);   o_hi[a] = std::max(o_hi[a], o[a][k]);
+                inv_lo[a] = std::min(inv_lo[a], inv[a][k]); inv_hi[a] = std::max(inv_hi[a], inv[a][k]);
+                bounded = bounded && std::isfinite(inv[a][k]);
+            }
+            t_far[k] = float(t_max[k]);
+        }
+        update_t_far_max();
+    }
+
+    void update_t_far_max() {
+        t_far_max = -std::numeric_limits<float>::infinity();
+        for (int k = 0; k < N; ++k)
+            if (live >> k & 1u) t_far_max = std::max(t_far_max, t_far[k]);
+    }
+};
+
+// Interval-arithmetic frustum test: true when no ray of the packet can touch
+// the box. Each slab's entry/exit distance is bounded over the box spanned
+// by the lanes' origins and inverse directions, so one test stands in for N.
+template <int N>
+inline bool packet_culled(const LinearBVHNode& n, const RayPacket<N>& P, float t_min) {
+    float tn = t_min, tf = P.t_far_max;
+    for (int a = 0; a < 3; ++a) {
+        float lo = P.neg[a] ? n.bmax[a] : n.bmin[a];
+        float hi = P.neg[a] ? n.bmin[a] : n.bmax[a];
+        float e0 = lo - P.o_hi[a], e1 = lo - P.o_lo[a];
+        float x0 = hi - P.o_hi[a], x1 = hi - P.o_lo[a];
+        float enter = std::min(std::min(e0 * P.inv_lo[a], e0 * P.inv_hi[a]),
+                               std::min(e1 * P.inv_lo[a], e1 * P.inv_hi[a]));
+        float exit  = std::max(std::max(x0 * P.inv_lo[a], x0 * P.inv_hi[a]),
+                               std::max(x1 * P.inv_lo[a], x1 * P.inv_hi[a]));
+        tn = std::max(tn, enter);
+        tf = std::min(tf, exit * WIDE_T_FAR_SCALE);
+    }
+    return tn > tf;
+}
+
+// ---------- lane kernels ----------
+// One box against every lane; returns the mask of lanes that overlap it.
+
+template <int N>
+struct ScalarPacket {
+    static uint32_t test(const LinearBVHNode& n, const RayPacket<N>& P, float t_min) {
+        uint32_t mask = 0;
+        for (int k = 0; k < N; ++k) {
+            float tn = t_min, tf = P.t_far[k];
+            for (int a = 0; a < 3; ++a) {
+                float lo = P.neg[a] ? n.bmax[a] : n.bmin[a];
+                float hi = P.neg[a] ? n.bmin[a] : n.bmax[a];
+                float t0 = (lo - P.o[a][k]) * P.inv[a][k];
+                float t1 = (hi - P.o[a][k]) * P.inv[a][k] * WIDE_T_FAR_SCALE;
+                tn = t0 > tn ? t0 : tn;
+                tf = t1 < tf ? t1 : tf;
+            }
+            if (tn <= tf) mask |= 1u << k;
+        }
+        return mask;
+    }
+};
+
+#if RT_X86_SIMD
+template <int N>
+struct SSEPacket {
+    RT_TARGET_SSE static uint32_t test(const LinearBVHNode& n, const RayPacket<N>& P, float t_min) {
+        const __m128 scale = _mm_set1_ps(WIDE_T_FAR_SCALE);
+        uint32_t mask = 0;
+        for (int base = 0; base < N; base += 4) {
+            __m128 tn = _mm_set1_ps(t_min);
+            __m128 tf = _mm_load_ps(P.t_far + base);
+            for (int a = 0; a < 3; ++a) {
+                __m128 lo  = _mm_set1_ps(P.neg[a] ? n.bmax[a] : n.bmin[a]);
+                __m128 hi  = _mm_set1_ps(P.neg[a] ? n.bmin[a] : n.bmax[a]);
+                __m128 o   = _mm_load_ps(P.o[a] + base);
+                __m128 inv = _mm_load_ps(P.inv[a] + base);
+                __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+                __m128 t1 = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(hi, o), inv), scale);
+                tn = _mm_max_ps(t0, tn);
+                tf = _mm_min_ps(t1, tf);
+            }
+            mask |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(tn, tf))) << base;
+        }
+        return mask;
+    }
+};
+
+template <int N>
+struct AVX2Packet {
+    static_assert(N % 8 == 0, "AVX2 packets come in multiples of 8 lanes");
+    RT_TARGET_AVX2 static uint32_t test(const LinearBVHNode& n, const RayPacket<N>& P, float t_min) {
+        const __m256 scale = _mm256_set1_ps(WIDE_T_FAR_SCALE);
+        uint32_t mask = 0;
+        for (int base = 0; base < N; base += 8) {
+            __m256 tn = _mm256_set1_ps(t_min);
+            __m256 tf = _mm256_load_ps(P.t_far + base);
+            for (int a = 0; a < 3; ++a) {
+                __m256 lo  = _mm256_set1_ps(P.neg[a] ? n.bmax[a] : n.bmin[a]);
+                __m256 hi  = _mm256_set1_ps(P.neg[a] ? n.bmin[a] : n.bmax[a]);
+                __m256 o   = _mm256_load_ps(P.o[a] + base);
+                __m256 inv = _mm256_load_ps(P.inv[a] + base);
+                __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(lo, o), inv);
+                __m256 t1 = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(hi, o), inv), scale);
+                tn = _mm256_max_ps(t0, tn);
+                tf = _mm256_min_ps(t1, tf);
+            }
+            mask |= uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ))) << base;
+        }
+        return mask;
+    }
+};
+#endif
+
+// Shared-stack packet traversal (root at nodes[0]). leaf(offset, count,
+// mask) intersects one leaf for the lanes in `mask` and returns the lanes it
+// hit, after lowering their t_far. AnyHit retires those lanes and returns
+// once none are left; otherwise the result is every lane that hit something.
+template <int N, class Lanes, bool AnyHit, class LeafFn>
+inline uint32_t traverse_packet_with(const LinearBVHNode* nodes, RayPacket<N>& P, float t_min,
+                                     bool frustum, LeafFn&& leaf) {
+    frustum = frustum && P.bounded;
+    uint32_t stack[64];
+    int sp = 0;
+    uint32_t current = 0;
+    uint32_t hits = 0;
+    RT_STAT(RenderStats& st = thread_stats();)
+
+    while (true) {
+        const LinearBVHNode& n = nodes[current];
+        RT_STAT(st.nodes_visited += uint64_t(__builtin_popcount(P.live));)
+        uint32_t mask = 0;
+        if (!(frustum && packet_culled(n, P, t_min)))
+            mask = Lanes::test(n, P, t_min) & P.live;
+        if (mask) {
+            if (n.count > 0) {
+                RT_STAT(st.prim_tests += uint64_t(n.count) * uint64_t(__builtin_popcount(mask));)
+                uint32_t got = leaf(n.offset, n.count, mask);
+                hits |= got;
+                if (AnyHit && got) {
+                    P.live &= ~got;
+                    if (!P.live) return hits;
+                }
+                if (got) P.update_t_far_max();
+                if (sp == 0) break;
+                current = stack[--sp];
+            } else if (P.neg[n.axis]) {
+                stack[sp++] = current + 1;
+                current = n.offset;
+            } else {
+                stack[sp++] = n.offset;
+                current = current + 1;
+            }
+        } else {
+            if (sp == 0) break;
+            current = stack[--sp];
+        }
+    }
+    return hits;
+}
+
+template <int N, bool AnyHit, class LeafFn>
+inline uint32_t traverse_packet(const LinearBVHNode* nodes, RayPacket<N>& P, float t_min,
+                                SimdLevel simd, bool frustum, LeafFn&& leaf) {
+#if RT_X86_SIMD
+    if constexpr (N % 8 == 0) {
+        if (simd == SimdLevel::AVX2)
+            return traverse_packet_with<N, AVX2Packet<N>, AnyHit>(nodes, P, t_min, frustum, leaf);
+    }
+    if (simd != SimdLevel::Scalar)
+        return traverse_packet_with<N, SSEPacket<N>, AnyHit>(nodes, P, t_min, frustum, leaf);
+#endif
+    return traverse_packet_with<N, ScalarPacket<N>, AnyHit>(nodes, P, t_min, frustum, leaf);
+}
+
+// Builds the RayPacket matching q.size and hands it to fn
+template <class Fn>
+inline uint32_t with_packet(const PacketQuery& q, const Real* t_max, Fn&& fn) {
+    switch (q.size) {
+    case 4:  { RayPacket<4>  P(q, t_max); return fn(P); }
+    case 8:  { RayPacket<8>  P(q, t_max); return fn(P); }
+    default: { RayPacket<16> P(q, t_max); return fn(P); }
+    }
+}
+
+// Closest hit of each lane against a LinearBVH over Hittables
+template <int N>
+inline uint32_t packet_hit(const LinearBVHNode* nodes, const Hittable* const* prims, RayPacket<N>& P,
+                           const PacketQuery& q, Real* t_max, HitRecord* rec) {
+    return traverse_packet<N, false>(nodes, P, float(q.t_min), q.simd, q.frustum,
+        [&](uint32_t offset, uint32_t count, uint32_t mask) {
+            PacketQuery sub = q;
+            sub.mask = mask;
+            uint32_t got = 0;
+            for (uint32_t i = 0; i < count; ++i) got |= prims[offset + i]->hit_lanes(sub, t_max, rec);
+            for (int k = 0; k < N; ++k)
+                if (got >> k & 1u) P.t_far[k] = float(t_max[k]);
+            return got;
+        });
+}
+
+// Blocked lanes against a LinearBVH over Hittables
+template <int N>
+inline uint32_t packet_occluded(const LinearBVHNode* nodes, const Hittable* const* prims, RayPacket<N>& P,
+                                const PacketQuery& q, const Real* t_max) {
+    return traverse_packet<N, true>(nodes, P, float(q.t_min), q.simd, q.frustum,
+        [&](uint32_t offset, uint32_t count, uint32_t mask) {
+            PacketQuery sub = q;
+            uint32_t got = 0;
+            for (uint32_t i = 0; i < count && mask; ++i) {
+                sub.mask = mask;
+                uint32_t b = prims[offset + i]->occluded_lanes(sub, t_max);
+                got |= b;
+                mask &= ~b;
+            }
+            return got;
+        });
+}
+
+// Moller-Trumbore of one triangle against every lane, written branch-free
+// over SoA lanes so the compiler vectorises it. Returns the lanes of `mask`
+// hit within [t_min, t_max[k]] and writes their distances to t_out.
+template <int N>
+inline uint32_t triangle_lanes(const RayPacket<N>& P, uint32_t mask,
+                               const Vec3& p0, const Vec3& e1, const Vec3& e2,
+                               Real t_min, const Real* t_max, Real* t_out) {
+    uint32_t hits = 0;
+    for (int k = 0; k < N; ++k) {
+        const Real dx = P.dd[0][k], dy = P.dd[1][k], dz = P.dd[2][k];
+        const Real pvx = dy * e2.z - dz * e2.y;
+        const Real pvy = dz * e2.x - dx * e2.z;
+        const Real pvz = dx * e2.y - dy * e2.x;
+        const Real det = e1.x * pvx + e1.y * pvy + e1.z * pvz;
+        const Real inv_det = 1.0 / det;
+        const Real tx = P.od[0][k] - p0.x, ty = P.od[1][k] - p0.y, tz = P.od[2][k] - p0.z;
+        const Real u = (tx * pvx + ty * pvy + tz * pvz) * inv_det;
+        const Real qx = ty * e1.z - tz * e1.y;
+        const Real qy = tz * e1.x - tx * e1.z;
+        const Real qz = tx * e1.y - ty * e1.x;
+        const Real w = (dx * qx + dy * qy + dz * qz) * inv_det;
+        const Real t = (e2.x * qx + e2.y * qy + e2.z * qz) * inv_det;
+        const bool ok = std::fabs(det) >= 1e-14 && u >= 0.0 && u <= 1.0 && w >= 0.0 && u + w <= 1.0 &&
+                        t >= t_min && t <= t_max[k];
+        t_out[k] = t;
+        hits |= uint32_t(ok) << k;
+    }
+    return hits & mask;
+}
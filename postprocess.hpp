@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "image_io.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+// Display transform: linear HDR radiance -> 8-bit output. Runs on the saved
+// film, never inside the render loop, so a new exposure only needs this
+// pass (a few milliseconds) instead of a re-render.
+
+// Photographic exposure for a camera's f-number, shutter time and ISO
+inline double exposure_scale(double fnum, double shutter_s, int iso) {
+    double EV100 = std::log2((fnum * fnum) / shutter_s);
+    return 0.18 * std::pow(2.0, -EV100) * (100.0 / double(iso));
+}
+
+// Exposure, the ACES filmic fit (Narkowicz 2015), clamped to [0,1], and
+// gamma 2 (sqrt), per channel. The SIMD kernels do the same float operations
+// in the same order and are compiled without FMA (which would fuse the
+// multiply-adds into one rounding), so every level produces the same bytes.
+struct ToneMap {
+    float exposure = 1.0f;
+
+    static constexpr float A = 2.51f, B = 0.03f, C = 2.43f, D = 0.59f, E = 0.14f;
+
+    float display(float x) const {
+        x *= exposure;
+        float t = (x * (A * x + B)) / (x * (C * x + D) + E);
+        t = t > 0.0f ? t : 0.0f;   // also maps NaN to 0
+        t = t < 1.0f ? t : 1.0f;
+        return std::sqrt(t);
+    }
+
+    // 256 levels of equal width, 1.0 in the top one
+    static unsigned char quantize(float v) { return (unsigned char)std::min(255, int(256.0f * v)); }
+};
+
+inline void tonemap_scalar(const ToneMap& tm, const float* in, unsigned char* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = ToneMap::quantize(tm.display(in[i]));
+}
+
+#if RT_X86_SIMD
+RT_TARGET_SSE inline void tonemap_sse(const ToneMap& tm, const float* in, unsigned char* out, size_t n) {
+    const __m128 ex = _mm_set1_ps(tm.exposure);
+    const __m128 a = _mm_set1_ps(ToneMap::A), b = _mm_set1_ps(ToneMap::B), c = _mm_set1_ps(ToneMap::C);
+    const __m128 d = _mm_set1_ps(ToneMap::D), e = _mm_set1_ps(ToneMap::E);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), levels = _mm_set1_ps(256.0f);
+    const __m128i top = _mm_set1_epi32(255);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), ex);
+        __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(a, x), b));
+        __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(c, x), d)), e);
+        __m128 t = _mm_min_ps(_mm_max_ps(_mm_div_ps(num, den), zero), one);
+        __m128i q = _mm_min_epi32(_mm_cvttps_epi32(_mm_mul_ps(levels, _mm_sqrt_ps(t))), top);
+        q = _mm_packus_epi32(q, q);
+        q = _mm_packus_epi16(q, q);
+        const int bytes = _mm_cvtsi128_si32(q);
+        std::memcpy(out + i, &bytes, 4);
+    }
+    tonemap_scalar(tm, in + i, out + i, n - i);
+}
+
+RT_TARGET_AVX2_EXACT inline void tonemap_avx2(const ToneMap& tm, const float* in, unsigned char* out, size_t n) {
+    const __m256 ex = _mm256_set1_ps(tm.exposure);
+    const __m256 a = _mm256_set1_ps(ToneMap::A), b = _mm256_set1_ps(ToneMap::B), c = _mm256_set1_ps(ToneMap::C);
+    const __m256 d = _mm256_set1_ps(ToneMap::D), e = _mm256_set1_ps(ToneMap::E);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), levels = _mm256_set1_ps(256.0f);
+    const __m256i top = _mm256_set1_epi32(255);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in + i), ex);
+        __m256 num = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(a, x), b));
+        __m256 den = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(c, x), d)), e);
+        __m256 t = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(num, den), zero), one);
+        __m256i q = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(levels, _mm256_sqrt_ps(t))), top);
+        __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+        w = _mm_packus_epi16(w, w);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), w);
+    }
+    tonemap_scalar(tm, in + i, out + i, n - i);
+}
+#endif
+
+// Tone maps n consecutive channel values (any mix of R, G and B: the curve
+// is the same for all three)
+inline void tonemap(const ToneMap& tm, const float* in, unsigned char* out, size_t n, SimdLevel simd) {
+#if RT_X86_SIMD
+    if (simd == SimdLevel::AVX2) return tonemap_avx2(tm, in, out, n);
+    if (simd == SimdLevel::SSE)  return tonemap_sse(tm, in, out, n);
+#endif
+    (void)simd;
+    tonemap_scalar(tm, in, out, n);
+}
+
+// The whole film to 8-bit RGB, in bands of rows spread over the pool
+// (serial without one)
+inline void tonemap_image(const HdrImage& img, const ToneMap& tm, std::vector<unsigned char>& out,
+                          SimdLevel simd, WorkStealingPool* pool) {
+    static const int ROWS_PER_TASK = 16;
+    out.resize(img.rgb.size());
+    const size_t tasks = size_t(img.height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    const size_t row_values = size_t(img.width) * 3;
+    auto task = [&](size_t t, unsigned) {
+        const int y0 = int(t) * ROWS_PER_TASK, y1 = std::min(img.height, y0 + ROWS_PER_TASK);
+        tonemap(tm, img.row(y0), &out[size_t(y0) * row_values], size_t(y1 - y0) * row_values, simd);
+    };
+    if (pool) pool->run(tasks, task);
+    else for (size_t t = 0; t < tasks; ++t) task(t, 0);
+}
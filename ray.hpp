@@ -3,17 +3,20 @@
 
 #include "vec3.hpp"
 
-class Ray {
+template <class T>
+class RayT {
 public:
-    Vec3 origin;
-    Vec3 direction;
-    double time; // NEW: time the ray was generated (for motion blur)
+    Vec3T<T> origin;
+    Vec3T<T> direction;
+    T time; // NEW: time the ray was generated (for motion blur)
 
-    Ray() : time(0.0) {}
-    Ray(const Vec3& origin, const Vec3& direction, double time = 0.0)
+    RayT() : time(0) {}
+    RayT(const Vec3T<T>& origin, const Vec3T<T>& direction, T time = 0)
         : origin(origin), direction(direction), time(time) {}
 
-    Vec3 at(double t) const { return origin + t * direction; }
+    Vec3T<T> at(T t) const { return origin + t * direction; }
 };
 
+using Ray = RayT<Real>;
+
 #endif
@@ -1,16 +1,20 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <csignal>
+#include <cstdio>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <cstdlib>
+#include <string>
 #include <vector>
 
 #include "vec3.hpp"
 #include "ray.hpp"
 #include "hittable.hpp"
-#include "hittable_list.hpp"
 #include "sphere.hpp"
 #include "xz_rect.hpp"
 #include "camera.hpp"
@@ -23,6 +27,24 @@
 #include "xy_rect.hpp"
 #include "yz_rect.hpp"
 #include "bvh.hpp"  // Your BVHNode header
+#include "linear_bvh.hpp"
+#include "wide_bvh.hpp"
+#include "mesh_loader.hpp"
+#include "lights.hpp"
+#include "scene.hpp"
+#include "scene_cache.hpp"
+#include "transform.hpp"
+#include "direct_light.hpp"
+#include "wavefront.hpp"
+#include "thread_pool.hpp"
+#include "tiles.hpp"
+#include "cornell.hpp"
+#include "animation.hpp"
+#include "checkpoint.hpp"
+#include "film.hpp"
+#include "image_io.hpp"
+#include "postprocess.hpp"
+#include "stats.hpp"
 
 // ----------------------- RENDER CONFIG -----------------------
 static const bool PREVIEW = true;
@@ -45,61 +67,332 @@ static const double F_NUMBER = 2.0;
 static const double SHUTTER  = 1.0/30;
 static const int    ISO      = 400;
 static const double EXPOSURE_COMP = 8.0;
+
+// Defaults for the tile renderer (overridable on the command line)
+static const int       RENDER_THREADS = 0;    // 0 => one per hardware thread
+static const int       TILE_SIZE      = 32;
+static const TileOrder TILE_ORDER     = TileOrder::Hilbert;
+static const int       BVH_WIDTH      = 8;    // 2 => linear binary BVH, 4/8 => SIMD-wide BVH
+static const LightSelect LIGHT_SELECT = LightSelect::Power; // how NEE picks one light per sample (bvh: better for spread-out lights)
+static const IntegratorKind INTEGRATOR = IntegratorKind::Recursive; // wavefront: queue-based, one bounce per pass over a tile
+static const int       PACKET_SIZE    = 8;    // wavefront only: rays per packet (1 => single-ray traversal)
+static const SamplerType SAMPLER      = SamplerType::Sobol; // independent: white noise baseline; sobol/halton: scrambled low-discrepancy points
+static const char*     STATS_JSON     = "stats.json"; // -DRT_STATS builds only: where the counters are written
+
+// Progressive rendering: samples are added in passes over the whole image
+static const int       PASS_SPP       = 4;    // samples per pixel per pass
+static const double    CHECKPOINT_SECONDS = 300; // with --checkpoint: at most this long between checkpoints
+
+// Adaptive sampling: a pixel stops once one standard error of its mean
+// moves its final (tone mapped, gamma encoded) value by less than the
+// threshold, in display units of 0..1
+static const double    ADAPTIVE_THRESHOLD = 0.0;  // 0 => every pixel gets the full spp
+static const int       ADAPTIVE_MIN_SPP   = 16;   // samples before a pixel may stop
+static const int       ADAPTIVE_RADIUS    = 2;    // error estimates are pooled over a (2r+1)^2 pixel window
+
+// Denoising: an edge-aware a-trous filter guided by first-hit albedo,
+// normal and depth, run on the HDR image before tone mapping
+static const bool      DENOISE        = false;
+static const bool      WRITE_AOVS     = false; // also write albedo.ppm, normal.ppm and depth.ppm
+static const HdrFormat HDR_OUTPUT     = HdrFormat::None; // pfm/exr: also save the linear film next to each PPM
+static const FilterType PIXEL_FILTER  = FilterType::Box;  // gaussian/mitchell/blackman-harris: samples also reach neighbouring pixels
+
+// Sequence rendering (--frames)
+static const char*     FRAME_PATTERN  = "frame_%04d.ppm";
+static const double    TURNTABLE_TURNS = 1.0;  // mesh turns over the whole sequence
+static const double    REFIT_REBUILD_RATIO = 1.3; // rebuild the top level once refits push its SAH cost this far above the last build
 // -------------------------------------------------------------
 
-static inline double clamp01(double x){ return x<0 ? 0 : (x>1 ? 1 : x); }
+struct RenderSettings {
+    int       threads    = RENDER_THREADS;
+    int       tile_size  = TILE_SIZE;
+    TileOrder tile_order = TILE_ORDER;
+    uint64_t  seed       = uint64_t(time(0));
+    BVHBuildMethod bvh   = BVHBuildMethod::SAH;
+    int       bvh_width  = BVH_WIDTH;
+    SimdLevel simd       = detect_simd();
+    LightSelect lights   = LIGHT_SELECT;
+    IntegratorKind integrator = INTEGRATOR;
+    SamplerType sampler  = SAMPLER;
+    bool      motion_blur = motion_blur_enabled;
+    int       packet     = PACKET_SIZE;
+    std::string mesh_path;                 // optional OBJ/PLY placed in the room
+    int       mesh_copies = 1;             // > 1: that many instances of the one mesh
+    std::string cache_path;                // binary scene/BVH cache, reused when its hash matches
+    std::string stats_path = STATS_JSON;   // render statistics (RT_STATS builds)
+    std::string heatmap_path;              // per-pixel traversal cost image (RT_STATS builds)
+    int       frames      = 0;             // > 0: render an animation sequence of this many frames
+    int       first_frame = 0;             // --frame-range: the part of the sequence to render
+    int       last_frame  = -1;            // inclusive; -1 => to the end
+    int       spp         = 0;             // samples per pixel; 0 => SPP_PREVIEW / SPP_FINAL
+    int       pass_spp    = PASS_SPP;
+    std::string checkpoint_path;           // where progress is saved between passes (single images only)
+    double    checkpoint_every = CHECKPOINT_SECONDS;
+    std::string resume_path;               // checkpoint to continue from
+    double    adaptive    = ADAPTIVE_THRESHOLD; // > 0: per-pixel adaptive sampling, --spp is then the cap
+    int       min_spp     = ADAPTIVE_MIN_SPP;
+    std::string sample_map_path;           // image of samples spent per pixel
+    bool      denoise     = DENOISE;
+    bool      aovs        = WRITE_AOVS;
+    HdrFormat hdr         = HDR_OUTPUT;
+    FilterType filter     = PIXEL_FILTER;
+    double    exposure_ev = 0.0;           // exposure compensation in stops on top of the camera's
+    std::string post_path;                 // tone map this saved film instead of rendering
+};
+
+static void print_usage(const char* argv0){
+    std::cerr << "usage: " << argv0
+              << " [--threads N] [--tile-size N] [--tile-order scanline|spiral|hilbert] [--seed N]"
+              << " [--bvh sah|median] [--bvh-width 2|4|8] [--simd auto|scalar|sse|avx2] [--mesh file.obj|file.ply] [--mesh-copies N]"
+              << " [--cache file.rtc] [--lights power|bvh]"
+              << " [--integrator recursive|wavefront] [--packet 1|4|8|16] [--sampler independent|sobol|halton]"
+              << " [--stats file.json] [--heatmap file.ppm] [--motion-blur on|off]"
+              << " [--frames N] [--frame-range A-B]"
+              << " [--spp N] [--pass-spp N] [--checkpoint file.ckpt] [--checkpoint-every S] [--resume file.ckpt]"
+              << " [--adaptive T] [--min-spp N] [--sample-map file.ppm] [--denoise on|off] [--aovs on|off]"
+              << " [--hdr none|pfm|exr] [--exposure EV] [--post file.pfm|file.exr]"
+              << " [--filter box|gaussian|mitchell|blackman-harris]\n";
+}
 
-static inline double exposure_scale(double fnum, double shutter_s, int iso){
-    double EV100 = std::log2((fnum*fnum)/shutter_s);
-    return 0.18 * std::pow(2.0, -EV100) * (100.0/double(iso));
+static bool parse_args(int argc, char** argv, RenderSettings& rs){
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (a + 1 >= argc) { print_usage(argv[0]); return false; }
+        std::string val = argv[++a];
+        if      (arg == "--threads")    rs.threads   = std::max(0, std::atoi(val.c_str()));
+        else if (arg == "--tile-size")  rs.tile_size = std::max(1, std::atoi(val.c_str()));
+        else if (arg == "--seed")       rs.seed      = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--tile-order") {
+            if (!parse_tile_order(val, rs.tile_order)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--bvh") {
+            if (!parse_bvh_method(val, rs.bvh)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--bvh-width") {
+            rs.bvh_width = std::atoi(val.c_str());
+            if (rs.bvh_width != 2 && rs.bvh_width != 4 && rs.bvh_width != 8) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--mesh")       rs.mesh_path = val;
+        else if (arg == "--mesh-copies") rs.mesh_copies = std::max(1, std::atoi(val.c_str()));
+        else if (arg == "--cache")      rs.cache_path = val;
+        else if (arg == "--stats")      rs.stats_path = val;
+        else if (arg == "--heatmap")    rs.heatmap_path = val;
+        else if (arg == "--spp")        rs.spp = std::max(1, std::atoi(val.c_str()));
+        else if (arg == "--pass-spp")   rs.pass_spp = std::max(1, std::atoi(val.c_str()));
+        else if (arg == "--checkpoint") rs.checkpoint_path = val;
+        else if (arg == "--checkpoint-every") rs.checkpoint_every = std::max(0.0, std::atof(val.c_str()));
+        else if (arg == "--resume")     rs.resume_path = val;
+        else if (arg == "--adaptive")   rs.adaptive = std::max(0.0, std::atof(val.c_str()));
+        else if (arg == "--min-spp")    rs.min_spp = std::max(2, std::atoi(val.c_str()));
+        else if (arg == "--sample-map") rs.sample_map_path = val;
+        else if (arg == "--exposure")   rs.exposure_ev = std::atof(val.c_str());
+        else if (arg == "--post")       rs.post_path = val;
+        else if (arg == "--filter") {
+            if (!parse_filter_type(val, rs.filter)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--hdr") {
+            if (!parse_hdr_format(val, rs.hdr)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--frames")     rs.frames = std::max(0, std::atoi(val.c_str()));
+        else if (arg == "--frame-range") {
+            if (std::sscanf(val.c_str(), "%d-%d", &rs.first_frame, &rs.last_frame) != 2 ||
+                rs.first_frame < 0 || rs.last_frame < rs.first_frame) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--motion-blur") {
+            if (val != "on" && val != "off") { print_usage(argv[0]); return false; }
+            rs.motion_blur = val == "on";
+        }
+        else if (arg == "--denoise" || arg == "--aovs") {
+            if (val != "on" && val != "off") { print_usage(argv[0]); return false; }
+            (arg == "--denoise" ? rs.denoise : rs.aovs) = val == "on";
+        }
+        else if (arg == "--lights") {
+            if (!parse_light_select(val, rs.lights)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--integrator") {
+            if (!parse_integrator(val, rs.integrator)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--sampler") {
+            if (!parse_sampler_type(val, rs.sampler)) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--packet") {
+            rs.packet = std::atoi(val.c_str());
+            if (rs.packet != 1 && rs.packet != 4 && rs.packet != 8 && rs.packet != 16) { print_usage(argv[0]); return false; }
+        }
+        else if (arg == "--simd") {
+            if (!parse_simd_level(val, rs.simd)) { print_usage(argv[0]); return false; }
+        }
+        else { print_usage(argv[0]); return false; }
+    }
+    return true;
 }
 
-static inline Vec3 aces_tonemap(const Vec3& c){
-    const double a=2.51,b=0.03,c2=2.43,d=0.59,e=0.14;
-    auto tm=[&](double x){ double num=x*(a*x+b), den=x*(c2*x+d)+e; return clamp01(num/den); };
-    return Vec3(tm(c.x), tm(c.y), tm(c.z));
+
+static inline double clamp01(double x){ return x<0 ? 0 : (x>1 ? 1 : x); }
+
+// Exposure of the final image: the camera settings plus --exposure
+static ToneMap tone_map(const RenderSettings& rs){
+    ToneMap tm;
+    tm.exposure = float(exposure_scale(F_NUMBER, SHUTTER, ISO) * EXPOSURE_COMP * std::exp2(rs.exposure_ev));
+    return tm;
 }
 
-static inline bool get_lambert_albedo(const std::shared_ptr<Material>& m, Vec3& out_albedo){
-    auto* lam = dynamic_cast<Lambertian*>(m.get());
-    if (!lam) return false;
-    out_albedo = lam->albedo;
+// --post: tone maps a film saved with --hdr to a PPM next to it, without
+// rendering
+static bool post_process(const RenderSettings& rs){
+    HdrImage film;
+    if (!read_hdr(rs.post_path, film)) return false;
+    std::unique_ptr<WorkStealingPool> pool;
+    if (rs.threads != 1) pool = std::make_unique<WorkStealingPool>(unsigned(rs.threads));
+    std::vector<unsigned char> img;
+    auto t0 = std::chrono::steady_clock::now();
+    tonemap_image(film, tone_map(rs), img, rs.simd, pool.get());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    const std::string path = replace_extension(rs.post_path, ".ppm");
+    if (!write_ppm(path, film.width, film.height, img.data())) return false;
+    std::cerr << "Post-processed " << rs.post_path << " (" << film.width << "x" << film.height << ", "
+              << simd_name(rs.simd) << ") in " << ms << " ms, written to " << path << "\n";
     return true;
 }
 
-static bool rect_pdf_omega_from_dir(const XZRect& rect, const Vec3& p, const Vec3& wi,
-                                    double& pdf_omega, double& cos_l, double& dist)
-{
-    if (std::fabs(wi.y) < 1e-8) return false;
-    double t = (rect.k - p.y) / wi.y;
-    if (t <= 0.001) return false;
+// Writes the mean first-hit guides as albedo.ppm, normal.ppm and depth.ppm
+static bool write_aovs(const RenderProgress& progress){
+    const size_t n = progress.samples.size();
+    std::vector<Features> mean(n);
+    double far = 0.0, near = std::numeric_limits<double>::infinity();
+    for (size_t p = 0; p < n; ++p) {
+        mean[p] = progress.features[p].mean(progress.samples[p]);
+        if (mean[p].depth > 0) { far = std::max(far, mean[p].depth); near = std::min(near, mean[p].depth); }
+    }
+    auto write = [&](const char* path, auto&& rgb){
+        std::vector<unsigned char> img(n * 3);
+        for (size_t p = 0; p < n; ++p) {
+            Vec3 c = rgb(mean[p]);
+            img[3 * p]     = (unsigned char)(255.0 * clamp01(c.x) + 0.5);
+            img[3 * p + 1] = (unsigned char)(255.0 * clamp01(c.y) + 0.5);
+            img[3 * p + 2] = (unsigned char)(255.0 * clamp01(c.z) + 0.5);
+        }
+        return write_ppm(path, progress.width, progress.height, img.data());
+    };
+    bool ok = write("albedo.ppm", [](const Features& f){
+        return Vec3(std::sqrt(f.albedo.x), std::sqrt(f.albedo.y), std::sqrt(f.albedo.z));
+    });
+    ok &= write("normal.ppm", [](const Features& f){ return 0.5 * f.normal + Vec3(0.5, 0.5, 0.5); });
+    ok &= write("depth.ppm", [&](const Features& f){
+        double v = f.depth > 0 && far > near ? 1.0 - 0.9 * (f.depth - near) / (far - near) : 0.0;
+        return Vec3(v, v, v);
+    });
+    return ok;
+}
 
-    Vec3 hit = p + wi * t;
-    if (hit.x < rect.x0 || hit.x > rect.x1 || hit.z < rect.z0 || hit.z > rect.z1) return false;
+// Uniformly scales and moves a mesh so its largest extent is `size` and its
+// bounding box sits centred on `floor_center`
+static void fit_mesh(MeshData& m, const Vec3& floor_center, double size){
+    if (m.px.empty()) return;
+    float lo[3] = {m.px[0], m.py[0], m.pz[0]}, hi[3] = {m.px[0], m.py[0], m.pz[0]};
+    for (size_t i = 0; i < m.px.size(); ++i) {
+        lo[0] = std::min(lo[0], m.px[i]); hi[0] = std::max(hi[0], m.px[i]);
+        lo[1] = std::min(lo[1], m.py[i]); hi[1] = std::max(hi[1], m.py[i]);
+        lo[2] = std::min(lo[2], m.pz[i]); hi[2] = std::max(hi[2], m.pz[i]);
+    }
+    double extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    double scale = extent > 0 ? size / extent : 1.0;
+    double cx = 0.5 * (lo[0] + hi[0]), cz = 0.5 * (lo[2] + hi[2]);
+    for (size_t i = 0; i < m.px.size(); ++i) {
+        m.px[i] = float(floor_center.x + (m.px[i] - cx)    * scale);
+        m.py[i] = float(floor_center.y + (m.py[i] - lo[1]) * scale);
+        m.pz[i] = float(floor_center.z + (m.pz[i] - cz)    * scale);
+    }
+}
 
-    dist = t;
-    cos_l = std::max(0.0, dot(rect.light_normal(), -wi));
-    if (cos_l <= 0.0) return false;
+// Places `count` instances of `geometry` (fitted to unit size, standing on
+// the origin) in a grid on the floor around `floor_center`, each turned a
+// little further about the vertical
+static std::vector<Instance*> place_copies(Scene& scene, const Hittable& geometry, int count,
+                                           const Vec3& floor_center, double size){
+    std::vector<Instance*> placed;
+    const int cols = int(std::ceil(std::sqrt(double(count))));
+    const int rows = (count + cols - 1) / cols;
+    const double cell = std::min(1.6 / cols, 1.2 / rows);
+    const double s = std::min(size, 0.8 * cell);
+    for (int k = 0; k < count; ++k) {
+        Vec3 at(floor_center.x + (k % cols - 0.5 * (cols - 1)) * cell, floor_center.y,
+                floor_center.z + (k / cols - 0.5 * (rows - 1)) * cell);
+        placed.push_back(&scene.add_instance(geometry, Transform::translate(at) * Transform::rotate_y(37.0 * k) * Transform::scale(s)));
+    }
+    return placed;
+}
 
-    double A = rect.area();
-    double dist2 = dist * dist;
-    pdf_omega = dist2 / (cos_l * A);
-    return pdf_omega > 1e-12;
+// Hash of everything a scene cache is derived from: the scene records, the
+// mesh source bytes and placement, and the BVH build options
+static bool scene_source_hash(const Scene& scene,
+                              const std::string& mesh_path, const Vec3& mesh_floor, double mesh_size,
+                              const BVHBuildOptions& opts, uint64_t& hash){
+    SceneTables tables;
+    if (!describe_scene(scene, tables)) return false;
+    hash = hash_scene(tables);
+    const double build[5] = {double(opts.method), double(opts.bins), opts.traversal_cost,
+                             opts.intersect_cost, double(opts.max_leaf_size)};
+    hash = hash_bytes(build, sizeof(build), hash);
+    if (!mesh_path.empty()) {
+        MappedFile src(mesh_path);
+        if (!src.is_open()) return false;
+        const double fit[4] = {mesh_floor.x, mesh_floor.y, mesh_floor.z, mesh_size};
+        hash = hash_bytes(src.data(), src.size(), hash);
+        hash = hash_bytes(fit, sizeof(fit), hash);
+    }
+    return true;
 }
 
-Vec3 ray_color(const Ray& r, const Hittable& world, const XZRect* area_light, int depth, int max_depth){
-    if (depth <= 0) return Vec3(0,0,0);
+// Hash of the options that decide what a checkpoint's sums converge to;
+// resuming under others would mix samples of different images (size and
+// seed are stored and checked on their own)
+static uint64_t progress_key(const RenderSettings& rs, int max_depth){
+    const int32_t opts[6] = {max_depth, rs.mesh_copies, int32_t(rs.motion_blur), int32_t(depth_of_field), int32_t(rs.sampler),
+                             int32_t(rs.filter)};
+    return hash_bytes(rs.mesh_path.data(), rs.mesh_path.size(), hash_bytes(opts, sizeof(opts)));
+}
 
+// Set on SIGTERM/SIGINT while checkpointing: the render stops after the
+// running pass and saves its progress
+static volatile std::sig_atomic_t stop_requested = 0;
+static void request_stop(int){ stop_requested = 1; }
+
+static const int LIGHT_SAMPLES_PER_HIT = PREVIEW ? LIGHT_SAMPLES_PREVIEW : LIGHT_SAMPLES_FINAL;
+// Where each bounce's sampler dimensions start
+static const PathDims PATH_DIMS{uint32_t(LIGHT_SAMPLES_PER_HIT), uint32_t(BRDF_SAMPLES_PER_HIT)};
+
+// `first`, given for camera rays, receives the denoiser's guides at the hit
+Vec3 ray_color(const Ray& r, const Scene& scene, int depth, int max_depth,
+               Sampler& sampler, Features* first = nullptr){
+    RT_STAT(RenderStats& st = thread_stats();)
+    RT_STAT(const int segments = max_depth - depth + 1;)
+    if (depth <= 0) {
+        RT_STAT(st.end_path(max_depth);)
+        return Vec3(0,0,0);
+    }
+
+    RT_STAT(++(depth == max_depth ? st.camera_rays : st.indirect_rays);)
     HitRecord rec;
-    if (!world.hit(r, 0.001, std::numeric_limits<double>::infinity(), rec)) {
+    if (!scene.hit(r, 0, std::numeric_limits<Real>::infinity(), rec)) {
+        RT_STAT(st.end_path(segments);)
         return Vec3(0,0,0);
     }
 
-    Vec3 emitted = rec.mat->emitted(rec);
+    const Material& mat = scene.material(rec.mat);
+    Vec3 emitted = mat.emitted(rec);
+    if (first) {
+        first->albedo = mat.albedo();
+        first->normal = rec.normal;
+        first->depth = rec.t * r.direction.length();
+    }
 
+    const int bounce = max_depth - depth;
     Ray scattered;
     Vec3 attenuation;
-    if (!rec.mat->scatter(r, rec, attenuation, scattered)) {
+    sampler.seek(PATH_DIMS.scatter(bounce));
+    if (!mat.scatter(r, rec, attenuation, scattered, sampler)) {
+        RT_STAT(st.end_path(segments);)
         return emitted;
     }
 
@@ -107,68 +400,43 @@ Vec3 ray_color(const Ray& r, const Hittable& world, const XZRect* area_light, in
         double p = std::max(attenuation.x, std::max(attenuation.y, attenuation.z));
         p = clamp01(p);
         if (p < 0.05) p = 0.05;
-        if (random_double() > p) return emitted;
+        sampler.seek(PATH_DIMS.roulette(bounce));
+        if (sampler.next_1d() > p) {
+            RT_STAT(++st.rr_terminations; st.end_path(segments);)
+            return emitted;
+        }
         attenuation /= p;
     }
 
-    Vec3 indirect = attenuation * ray_color(scattered, world, area_light, depth - 1, max_depth);
+    Vec3 indirect = attenuation * ray_color(scattered, scene, depth - 1, max_depth, sampler);
 
     Vec3 direct(0,0,0);
-    Vec3 albedo;
-    const int LIGHT_SAMPLES_PER_HIT = PREVIEW ? LIGHT_SAMPLES_PREVIEW : LIGHT_SAMPLES_FINAL;
 
-    if (area_light && get_lambert_albedo(rec.mat, albedo)) {
+    if (!scene.lights.empty() && mat.is_diffuse()) {
+        const Vec3& albedo = mat.color;
+        const Vec3 f = albedo / PI;
+
+        // Light sampling: one light per sample, picked by the scene's selector
         Vec3 L_light(0,0,0);
         for (int s=0; s<LIGHT_SAMPLES_PER_HIT; ++s) {
-            Vec3 lp = area_light->sample_point();
-            Vec3 toL = lp - rec.point;
-            double dist2 = dot(toL, toL);
-            if (dist2 <= 1e-12) continue;
-
-            double dist = std::sqrt(dist2);
-            Vec3 wi = toL / dist;
-
-            double cos_i = std::max(0.0, dot(rec.normal, wi));
-            double cos_l = std::max(0.0, dot(area_light->light_normal(), -wi));
-            if (cos_i <= 0.0 || cos_l <= 0.0) continue;
-
-            Ray shadow_ray(rec.point, wi);
-            HitRecord shadow_hit;
-            if (world.hit(shadow_ray, 0.001, dist - 0.001, shadow_hit)) continue;
-
-            double A = area_light->area();
-            double pdf_light = dist2 / (cos_l * A);
-            double pdf_brdf  = cos_i / PI;
-            double w = pdf_light / (pdf_light + pdf_brdf);
-
-            Vec3 Le = area_light->mat->emitted(rec);
-            Vec3 f  = (albedo / PI);
-            L_light += w * Le * f * (cos_i / pdf_light);
+            ShadowQuery q;
+            sampler.seek(PATH_DIMS.light(bounce, s));
+            if (!sample_light_query(scene, rec, f, r.time, sampler, q)) continue;
+            RT_STAT(++st.shadow_rays;)
+            if (!scene.occluded(q.ray, 0, q.t_max)) L_light += q.contribution;
         }
         L_light /= double(LIGHT_SAMPLES_PER_HIT);
 
+        // BRDF sampling: counts only when the sampled ray lands on a light
         Vec3 L_brdf(0,0,0);
-        ONB onb; onb.build_from_w(rec.normal);
         for (int s=0; s<BRDF_SAMPLES_PER_HIT; ++s) {
-            Vec3 local = random_cosine_direction();
-            Vec3 wi = onb.local(local);
-            double cos_i = std::max(0.0, dot(rec.normal, wi));
-            if (cos_i <= 0.0) continue;
-
-            double pdf_light=0, cos_l=0, dist=0;
-            if (!rect_pdf_omega_from_dir(*area_light, rec.point, wi, pdf_light, cos_l, dist))
-                continue;
-
-            Ray shadow_ray(rec.point, wi);
-            HitRecord shadow_hit;
-            if (world.hit(shadow_ray, 0.001, dist - 0.001, shadow_hit)) continue;
-
-            double pdf_brdf = cos_i / PI;
-            double w = pdf_brdf / (pdf_brdf + pdf_light);
-
-            Vec3 Le = area_light->mat->emitted(rec);
-            Vec3 f  = (albedo / PI);
-            L_brdf += w * Le * f * (cos_i / pdf_brdf);
+            BrdfProbe q;
+            HitRecord lrec;
+            sampler.seek(PATH_DIMS.brdf(bounce, s));
+            if (!sample_brdf_probe(rec, r.time, sampler, q)) continue;
+            RT_STAT(++st.probe_rays;)
+            if (scene.hit(q.ray, 0, std::numeric_limits<Real>::infinity(), lrec))
+                L_brdf += brdf_probe_contribution(scene, rec.normal, f, q, lrec);
         }
         if (BRDF_SAMPLES_PER_HIT > 0) L_brdf /= double(BRDF_SAMPLES_PER_HIT);
 
@@ -178,93 +446,430 @@ Vec3 ray_color(const Ray& r, const Hittable& world, const XZRect* area_light, in
     return emitted + direct + indirect;
 }
 
-int main(){
-    srand((unsigned)time(0));
+int main(int argc, char** argv){
+    RenderSettings settings;
+    if (!parse_args(argc, argv, settings)) return 1;
+    if (!settings.post_path.empty()) return post_process(settings) ? 0 : 1;
 
     const int width  = 640;
     const int height = 360;
-    const int samples_per_pixel = PREVIEW ? SPP_PREVIEW : SPP_FINAL;
+    const int samples_per_pixel = settings.spp > 0 ? settings.spp : (PREVIEW ? SPP_PREVIEW : SPP_FINAL);
     const int max_depth         = PREVIEW ? MAX_DEPTH_PREVIEW : MAX_DEPTH_FINAL;
     const double aspect = double(width) / double(height);
 
-    std::ofstream file("image.ppm", std::ios::binary);
-    file << "P6\n" << width << " " << height << "\n255\n";
-    std::vector<unsigned char> out;
-    out.reserve(width * height * 3);
-
-    // Move camera further back & adjust FOV
-    Vec3 lookfrom(0.0, 1.0, 1.2);   // was (0.0, 1.0, 0.90)
-    Vec3 lookat  (0.0, 1.0, -1.10);
-    double focus_dist = (lookfrom - lookat).length();
-    double aperture   = depth_of_field ? 0.12 : 0.0;
-
-    double time0 = 0;
-    double time1 = 1;
-
-    Camera cam(lookfrom, lookat, Vec3(0,1,0),
-            50.0,  // wider FOV than before (was 40.0)
-            aspect,
-            aperture, focus_dist,
-            time0, time1);
-
-
-    // Room bounds
-    const double room_min_x = -1.0, room_max_x =  1.0;
-    const double room_min_y =  0.0, room_max_y =  2.0;
-    const double room_min_z = -2.2, room_max_z =  0.2;
-
-    HittableList objects;
-
-    auto white   = std::make_shared<Lambertian>(Vec3(0.75, 0.75, 0.75));
-    auto red     = std::make_shared<Lambertian>(Vec3(0.75, 0.15, 0.15));
-    auto green   = std::make_shared<Lambertian>(Vec3(0.15, 0.75, 0.15));
-    auto steel   = std::make_shared<Metal>(Vec3(0.75, 0.75, 0.75), 0.05);
-    auto glass   = std::make_shared<Dielectric>(1.5);
-    auto light_mat = std::make_shared<DiffuseLight>(Vec3(1.0, 0.97, 0.92), 8000.0);
-
-    objects.add(std::make_shared<XZRect>(room_min_x, room_max_x, room_min_z, room_max_z, room_min_y, white));
-    objects.add(std::make_shared<XZRect>(room_min_x, room_max_x, room_min_z, room_max_z, room_max_y, white));
-
-    objects.add(std::make_shared<XYRect>(room_min_x, room_max_x, room_min_y, room_max_y, room_min_z, white));
-    objects.add(std::make_shared<YZRect>(room_min_y, room_max_y, room_min_z, room_max_z, room_min_x, red));
-    objects.add(std::make_shared<YZRect>(room_min_y, room_max_y, room_min_z, room_max_z, room_max_x, green));
-
-    const double Lx0 = -0.4, Lx1 = 0.4;
-    const double Lz0 = -1.0, Lz1 = -0.2;
-    const double Ly  = 1.95;
-    auto rect_light = std::make_shared<XZRect>(Lx0, Lx1, Lz0, Lz1, Ly, light_mat);
-    objects.add(rect_light);
-
-    objects.add(std::make_shared<Sphere>(Vec3(-0.4, 0.35, -1.4), 0.35, glass));
-    objects.add(std::make_shared<Sphere>(Vec3( 0.5, 0.50, -1.0), 0.50, steel));
-
-    // Build BVH
-    std::vector<std::shared_ptr<Hittable>> objs_vec = objects.objects;
-    BVHNode world(objs_vec, 0, objs_vec.size());
-
-    double exposure = exposure_scale(F_NUMBER, SHUTTER, ISO) * EXPOSURE_COMP;
-
-    for (int j = height - 1; j >= 0; --j) {
-        for (int i = 0; i < width; ++i) {
-            Vec3 pixel(0,0,0);
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                double u = (i + random_double()) / (width  - 1);
-                double v = (j + random_double()) / (height - 1);
-                Ray r = cam.get_ray(u, v);
-                pixel += ray_color(r, world, rect_light.get(), max_depth, max_depth);
+    Scene scene;
+    CornellRoom room = build_cornell_room(scene, aspect, depth_of_field ? 0.12 : 0.0, settings.motion_blur);
+    const Camera& cam = room.camera;
+    const MaterialId white = room.white;
+    const Vec3   mesh_floor = room.mesh_floor;
+    const double mesh_size  = room.mesh_size;
+
+    // Sequence mode keeps this one scene resident and poses it per frame
+    const bool sequence = settings.frames > 0;
+    const int first_frame = std::min(settings.first_frame, std::max(0, settings.frames - 1));
+    const int last_frame  = settings.last_frame < 0 ? settings.frames - 1
+                                                    : std::min(settings.last_frame, settings.frames - 1);
+    Animation anim;
+    if (sequence) animate_cornell_room(anim, room);
+
+    BVHBuildOptions bvh_opts;
+    bvh_opts.method = settings.bvh;
+
+    // Reuse a cached scene when its source hash matches
+    uint64_t scene_hash = 0;
+    if (!settings.cache_path.empty() && (settings.mesh_copies > 1 || sequence))
+        std::cerr << "Scene cache: not used for instanced meshes or animations\n";
+    bool cacheable = !settings.cache_path.empty() && settings.mesh_copies == 1 && !sequence &&
+        scene_source_hash(scene, settings.mesh_path, mesh_floor, mesh_size, bvh_opts, scene_hash);
+    if (cacheable) {
+        auto t0 = std::chrono::steady_clock::now();
+        Scene cached;
+        if (load_scene_cache(settings.cache_path, scene_hash, cached)) {
+            scene = std::move(cached);
+            std::cerr << "Scene cache " << settings.cache_path << ": loaded "
+                      << scene.objects.size() << " prims in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()
+                      << " ms\n";
+        }
+    }
+
+    if (!scene.flat) {
+        if (!settings.mesh_path.empty()) {
+            auto t0 = std::chrono::steady_clock::now();
+            MeshData data;
+            if (!load_mesh(settings.mesh_path, data)) return 1;
+            auto t1 = std::chrono::steady_clock::now();
+            TriangleMesh* mesh;
+            if (settings.mesh_copies > 1 || sequence) {
+                // One bottom-level mesh BVH, instanced by the top level (and
+                // turned by moving the instances, never the mesh itself)
+                fit_mesh(data, Vec3(0,0,0), 1.0);
+                mesh = &scene.add_geometry<TriangleMesh>(std::move(data), white);
+                for (Instance* inst : place_copies(scene, *mesh, settings.mesh_copies, mesh_floor, mesh_size))
+                    if (sequence) add_turntable(anim, *inst, TURNTABLE_TURNS);
+            } else {
+                fit_mesh(data, mesh_floor, mesh_size);
+                mesh = &scene.add<TriangleMesh>(std::move(data), white);
             }
-            pixel /= double(samples_per_pixel);
-            pixel *= exposure;
-            Vec3 mapped = aces_tonemap(pixel);
-            mapped = Vec3(std::sqrt(mapped.x), std::sqrt(mapped.y), std::sqrt(mapped.z));
-
-            out.push_back((unsigned char)(256 * clamp01(mapped.x)));
-            out.push_back((unsigned char)(256 * clamp01(mapped.y)));
-            out.push_back((unsigned char)(256 * clamp01(mapped.z)));
+            std::cerr << "Mesh " << settings.mesh_path << ": " << mesh->triangle_count() << " triangles, loaded in "
+                      << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, BVH in "
+                      << mesh->build_stats.build_ms << " ms, "
+                      << mesh->memory_bytes() / (1024.0 * 1024.0) << " MiB resident";
+            if (settings.mesh_copies > 1)
+                std::cerr << ", " << settings.mesh_copies << " instances ("
+                          << settings.mesh_copies * mesh->memory_bytes() / (1024.0 * 1024.0) << " MiB if copied)";
+            std::cerr << "\n";
+        }
+
+        // Build the top-level BVH (for the first frame's pose)
+        if (sequence) anim.pose(double(first_frame) / settings.frames);
+        BVHBuildStats bvh_stats;
+        scene.build_top_level(bvh_opts, &bvh_stats);
+        std::cerr << "BVH (" << (settings.bvh == BVHBuildMethod::SAH ? "sah" : "median") << "): "
+                  << scene.objects.size() << " prims, " << bvh_stats.nodes << " nodes, "
+                  << bvh_stats.leaves << " leaves, depth " << bvh_stats.max_depth
+                  << ", SAH cost " << bvh_stats.sah_cost
+                  << ", built in " << bvh_stats.build_ms << " ms\n";
+
+        if (cacheable && write_scene_cache(settings.cache_path, scene_hash, scene))
+            std::cerr << "Scene cache " << settings.cache_path << ": written\n";
+    }
+
+    scene.collect_lights(settings.lights);
+    std::cerr << "Lights: " << scene.lights.size() << " emitters, "
+              << (settings.lights == LightSelect::BVH ? "light BVH" : "power alias table") << " selection\n";
+    scene.build_accel(settings.bvh_width, settings.simd);
+    // 4-wide nodes top out at SSE
+    SimdLevel lane_simd = (settings.bvh_width == 4 && settings.simd == SimdLevel::AVX2) ? SimdLevel::SSE : settings.simd;
+    std::cerr << "Traversing " << settings.bvh_width << "-wide BVH"
+              << (settings.bvh_width > 2 ? std::string(" (") + simd_name(lane_simd) + ")" : "")
+              << "\n";
+
+    // Progressive state: HDR sums and sample counts per pixel. A resumed
+    // render continues the checkpoint's sample sequence under its seed.
+    RenderProgress progress;
+    progress.reset(width, height);
+    progress.seed = settings.seed;
+    progress.key = progress_key(settings, max_depth);
+    const bool checkpoints = !sequence && !(settings.checkpoint_path.empty() && settings.resume_path.empty());
+    if (sequence && !(settings.checkpoint_path.empty() && settings.resume_path.empty()))
+        std::cerr << "Checkpoints: not used for animations\n";
+    if (checkpoints && settings.checkpoint_path.empty()) settings.checkpoint_path = settings.resume_path;
+    if (checkpoints && !settings.resume_path.empty()) {
+        RenderProgress saved;
+        if (!load_checkpoint(settings.resume_path, saved)) return 1;
+        if (saved.width != width || saved.height != height || saved.key != progress.key) {
+            std::cerr << "checkpoint: " << settings.resume_path << " was rendered at another size or with other scene options\n";
+            return 1;
         }
+        progress = std::move(saved);
+        settings.seed = progress.seed;
+        std::cerr << "Resumed " << settings.resume_path << ": " << progress.min_samples()
+                  << " spp done, seed " << progress.seed << "\n";
+    }
+
+    const ToneMap tone = tone_map(settings);
+
+    // The display transform of a grey radiance, used to measure adaptive
+    // sampling noise in display units
+    auto to_display = [&](double lum){ return double(tone.display(float(lum))); };
+
+    // Traversal work per pixel summed over its samples, for --heatmap
+    RT_STAT(std::vector<double> heat(size_t(width) * height, 0.0);)
+
+    // Samples each pixel gets in the running pass, see plan_pass()
+    std::vector<uint32_t> pass_samples(size_t(width) * height, 0);
+    const bool adaptive = settings.adaptive > 0.0;
+    const uint32_t min_spp = uint32_t(std::min(settings.min_spp, samples_per_pixel));
+
+    // Decides the next pass: up to pass_spp more samples for every pixel
+    // short of samples_per_pixel, except (adaptive) pixels past min_spp whose
+    // error estimate is already below the threshold. Returns how many pixels
+    // get samples.
+    std::vector<double> error;
+    auto plan_pass = [&](){
+        if (adaptive) progress.display_error(to_display, ADAPTIVE_RADIUS, error);
+        size_t busy = 0;
+        for (size_t p = 0; p < pass_samples.size(); ++p) {
+            const uint32_t n = progress.samples[p];
+            uint32_t k = n < uint32_t(samples_per_pixel)
+                ? std::min<uint32_t>(settings.pass_spp, uint32_t(samples_per_pixel) - n) : 0;
+            if (k && adaptive && n >= min_spp && error[p] < settings.adaptive) k = 0;
+            pass_samples[p] = k;
+            busy += k > 0;
+        }
+        return busy;
+    };
+
+    // Image row y (top-down) corresponds to camera row j = height-1-y
+    auto render_tile_recursive = [&](const Tile& tile, FilmTile& film_tile){
+        Sampler sampler(settings.seed, settings.sampler);
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            int j = height - 1 - y;
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                RT_STAT(uint64_t w0 = traversal_work();)
+                const size_t p = size_t(y) * width + i;
+                Vec3 pixel = progress.sum[p];
+                double pixel_sq = progress.sum_sq[p];
+                Features guides = progress.features[p];
+                const uint32_t first = progress.samples[p];
+                for (uint32_t s = first; s < first + pass_samples[p]; ++s) {
+                    sampler.start(uint64_t(j) * width + i, s);
+                    Sample2 film = sampler.next_2d();
+                    double u = (i + film.u) / (width  - 1);
+                    double v = (j + film.v) / (height - 1);
+                    Ray r = cam.get_ray(u, v, sampler);
+                    Features f;
+                    Vec3 l = ray_color(r, scene, max_depth, max_depth, sampler, &f);
+                    pixel += l;
+                    pixel_sq += luminance(l) * luminance(l);
+                    guides.add(f);
+                    film_tile.add(i, y, film.u - 0.5, 0.5 - film.v, l);
+                }
+                progress.sum[p] = pixel;
+                progress.sum_sq[p] = pixel_sq;
+                progress.features[p] = guides;
+                progress.samples[p] = first + pass_samples[p];
+                RT_STAT(heat[p] += double(traversal_work() - w0);)
+            }
+        }
+    };
+
+    WavefrontParams wf;
+    wf.width = width;
+    wf.height = height;
+    wf.spp = samples_per_pixel;
+    wf.max_depth = max_depth;
+    wf.light_samples = LIGHT_SAMPLES_PER_HIT;
+    wf.brdf_samples = BRDF_SAMPLES_PER_HIT;
+    wf.seed = settings.seed;
+    wf.sampler = settings.sampler;
+    wf.packet_size = settings.packet;
+    wf.simd = settings.simd;
+
+    auto render_tile_wavefront = [&](WavefrontIntegrator& integrator, const Tile& tile, FilmTile& film_tile){
+        const int tw = tile.x1 - tile.x0;
+        const size_t pixels = size_t(tw) * (tile.y1 - tile.y0);
+        std::vector<Vec3> sums(pixels);
+        std::vector<double> sum_sq(pixels);
+        std::vector<Features> features(pixels);
+        std::vector<uint32_t> first(pixels), count(pixels);
+        for (int y = tile.y0; y < tile.y1; ++y)
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                const size_t p = size_t(y) * width + i, t = size_t(y - tile.y0) * tw + (i - tile.x0);
+                sums[t] = progress.sum[p];
+                sum_sq[t] = progress.sum_sq[p];
+                features[t] = progress.features[p];
+                first[t] = progress.samples[p];
+                count[t] = pass_samples[p];
+            }
+        integrator.render_tile(tile, first, count, sums, sum_sq, features, &film_tile);
+        for (int y = tile.y0; y < tile.y1; ++y)
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                const size_t p = size_t(y) * width + i, t = size_t(y - tile.y0) * tw + (i - tile.x0);
+                progress.sum[p] = sums[t];
+                progress.sum_sq[p] = sum_sq[t];
+                progress.features[p] = features[t];
+                progress.samples[p] = first[t] + count[t];
+                RT_STAT(heat[p] += integrator.pixel_work[t];)
+            }
+    };
+
+    // Each tile renders into its own FilmTile: its pixels go straight back
+    // to the film, what the filter spreads past its edges is merged after
+    // the pass (render_pass)
+    std::vector<Tile> tiles = make_tiles(width, height, settings.tile_size, settings.tile_order);
+    const Filter filter(settings.filter);
+    std::vector<FilmTile> film_tiles(tiles.size());
+
+    const bool wavefront = settings.integrator == IntegratorKind::Wavefront;
+    auto render_tile = [&](WavefrontIntegrator& integrator, size_t t){
+        const Tile& tile = tiles[t];
+        bool any = false;
+        for (int y = tile.y0; y < tile.y1 && !any; ++y)
+            for (int i = tile.x0; i < tile.x1 && !any; ++i) any = pass_samples[size_t(y) * width + i] > 0;
+        if (!any) return;
+        RT_STAT(auto t0 = std::chrono::steady_clock::now();)
+        FilmTile& film_tile = film_tiles[t];
+        film_tile.begin(progress.film, tile, filter);
+        if (wavefront) render_tile_wavefront(integrator, tile, film_tile);
+        else           render_tile_recursive(tile, film_tile);
+        film_tile.commit(progress.film);
+        RT_STAT(thread_stats().tiles.push_back({tile.x0, tile.y0, tile.x1, tile.y1,
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()});)
+    };
+
+    if (settings.integrator == IntegratorKind::Wavefront)
+        std::cerr << "Integrator: wavefront, " << (settings.packet > 1 ? std::to_string(settings.packet) + "-ray packets" : "single rays") << "\n";
+    else
+        std::cerr << "Integrator: recursive\n";
+    std::cerr << "Sampler: " << sampler_name(settings.sampler) << "\n";
+    std::cerr << "Pixel filter: " << filter_name(settings.filter) << " (radius " << filter.radius << " px)\n";
+
+    // The pool and the integrators' path buffers live across frames
+    std::unique_ptr<WorkStealingPool> pool;
+    if (settings.threads != 1) pool = std::make_unique<WorkStealingPool>(unsigned(settings.threads));
+    // One integrator per worker: its path buffers are reused tile to tile
+    std::vector<WavefrontIntegrator> integrators(pool ? pool->size() : 1, WavefrontIntegrator(scene, cam, wf));
+
+    // Resolves the film into a linear HDR image (denoised first with
+    // --denoise), tone maps it on the pool and hands the PPM, plus the HDR
+    // image itself with --hdr, to the writer thread: encoding and disk I/O
+    // overlap with the next pass or frame. Write errors surface at
+    // writer.wait().
+    Denoiser denoiser(width, height);
+    std::vector<Vec3> mean_color, denoised;
+    std::vector<double> mean_var;
+    std::vector<Features> guides;
+    double denoise_ms = 0.0, tonemap_ms = 0.0;
+    AsyncWriter writer;
+    auto write_image = [&](const std::string& path){
+        HdrImage film;
+        film.resize(width, height);
+        if (settings.denoise) {
+            auto t0 = std::chrono::steady_clock::now();
+            progress.means(mean_color, mean_var, guides);
+            denoiser.run(mean_color, mean_var, guides, denoised, pool.get());
+            denoise_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        for (size_t p = 0; p < progress.sum.size(); ++p) {
+            const Vec3 c = settings.denoise ? denoised[p] : progress.film.resolve(p);
+            film.rgb[3 * p] = float(c.x); film.rgb[3 * p + 1] = float(c.y); film.rgb[3 * p + 2] = float(c.z);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<unsigned char> img;
+        tonemap_image(film, tone, img, settings.simd, pool.get());
+        tonemap_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        const HdrFormat hdr = settings.hdr;
+        writer.submit([path, hdr, film = std::move(film), img = std::move(img)]{
+            bool ok = write_ppm(path, film.width, film.height, img.data());
+            if (hdr != HdrFormat::None) ok &= write_hdr(replace_extension(path, hdr_extension(hdr)), film, hdr);
+            return ok;
+        });
+    };
+
+    // Renders the pass plan_pass() decided on, then merges what the tiles'
+    // filters spread into their neighbours
+    auto render_pass = [&](){
+        if (!pool) {
+            for (size_t t = 0; t < tiles.size(); ++t) render_tile(integrators[0], t);
+        } else {
+            pool->run(tiles.size(), [&](size_t t, unsigned worker){
+                render_tile(integrators[worker], t);
+            });
+        }
+        progress.film.merge_aprons(film_tiles, pool.get());
+    };
+
+    // Renders passes until no pixel needs more samples. With checkpoints,
+    // the progress (and a preview image) is saved every checkpoint_every
+    // seconds, when a stop is requested, and at the end, so a later --resume
+    // with a higher --spp can extend the render.
+    auto render_image = [&](){
+        auto t0 = std::chrono::steady_clock::now();
+        auto saved = t0;
+        size_t busy;
+        while (!stop_requested && (busy = plan_pass()) > 0) {
+            auto p0 = std::chrono::steady_clock::now();
+            render_pass();
+            auto now = std::chrono::steady_clock::now();
+            if (!sequence)
+                std::cerr << "Pass: " << progress.mean_samples() << "/" << samples_per_pixel << " spp, "
+                          << 100.0 * double(busy) / double(pass_samples.size()) << "% of pixels sampled, "
+                          << std::chrono::duration<double>(now - p0).count() << " s\n";
+            if (checkpoints && std::chrono::duration<double>(now - saved).count() >= settings.checkpoint_every) {
+                if (save_checkpoint(settings.checkpoint_path, progress))
+                    std::cerr << "Checkpoint " << settings.checkpoint_path << ": " << progress.mean_samples() << " spp\n";
+                write_image("image.ppm");
+                saved = std::chrono::steady_clock::now();
+            }
+        }
+        if (checkpoints && save_checkpoint(settings.checkpoint_path, progress))
+            std::cerr << "Checkpoint " << settings.checkpoint_path << ": " << progress.mean_samples() << " spp\n";
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    double render_s = 0.0;
+    if (!sequence) {
+        if (checkpoints) {
+            // Preemption or Ctrl-C: finish the running pass, checkpoint, stop
+            std::signal(SIGTERM, request_stop);
+            std::signal(SIGINT, request_stop);
+        }
+        render_s = render_image();
+        std::cerr << "Rendered in " << render_s << " s" << (stop_requested ? " (stopped early)" : "") << "\n";
+        if (adaptive)
+            std::cerr << "Adaptive sampling: " << progress.mean_samples() << " spp mean ("
+                      << 100.0 * progress.mean_samples() / samples_per_pixel << "% of uniform)\n";
+        write_image("image.ppm");
+        if (settings.denoise) std::cerr << "Denoised in " << denoise_ms << " ms\n";
+        std::cerr << "Tone mapped in " << tonemap_ms << " ms (" << simd_name(settings.simd) << ")\n";
+        if (!writer.wait()) return 1;
+        if (settings.hdr != HdrFormat::None) std::cerr << "HDR film written to image" << hdr_extension(settings.hdr) << "\n";
+        if (settings.aovs && write_aovs(progress)) std::cerr << "AOVs written: albedo.ppm, normal.ppm, depth.ppm\n";
+        if (!settings.sample_map_path.empty()) {
+            std::vector<double> spent(progress.samples.begin(), progress.samples.end());
+            write_heatmap(settings.sample_map_path, spent, width, height, double(samples_per_pixel));
+            std::cerr << "Sample map " << settings.sample_map_path << ": red = " << samples_per_pixel << " spp\n";
+        }
+    } else {
+        // Between frames only the poses change: refit the top level in place
+        // and rebuild it only when the refit tree has become too costly
+        double update_ms = 0.0;
+        int rebuilds = 0;
+        for (int f = first_frame; f <= last_frame; ++f) {
+            auto t0 = std::chrono::steady_clock::now();
+            double ratio = 1.0;
+            bool rebuilt = f == first_frame;
+            if (f != first_frame) {
+                anim.pose(double(f) / settings.frames);
+                ratio = scene.refit_top_level();
+                if (ratio > REFIT_REBUILD_RATIO) {
+                    scene.build_top_level(bvh_opts);
+                    scene.build_accel(settings.bvh_width, settings.simd);
+                    rebuilt = true;
+                    ++rebuilds;
+                }
+            }
+            double pose_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+            progress.reset(width, height);
+            RT_STAT(std::fill(heat.begin(), heat.end(), 0.0);)
+            double frame_s = render_image();
+            render_s += frame_s;
+
+            t0 = std::chrono::steady_clock::now();
+            char name[64];
+            std::snprintf(name, sizeof(name), FRAME_PATTERN, f);
+            write_image(name);
+            double write_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            update_ms += pose_ms + write_ms;
+
+            std::cerr << "Frame " << f << ": BVH " << (!rebuilt ? "refit" : f == first_frame ? "built" : "rebuilt");
+            if (f != first_frame) std::cerr << " (refit SAH " << ratio << "x of last build)";
+            std::cerr << ", pose " << pose_ms << " ms, rendered in "
+                      << frame_s << " s, " << name << " post-processed in " << write_ms << " ms\n";
+        }
+        if (!writer.wait()) return 1;
+        const int count = last_frame - first_frame + 1;
+        std::cerr << "Rendered " << count << " frames in " << render_s << " s; "
+                  << update_ms << " ms outside path tracing, " << rebuilds << " BVH rebuilds\n";
+    }
+
+#ifdef RT_STATS
+    RenderStats stats = stats_registry().merged();
+    stats.print(std::cerr, render_s);
+    if (stats.write_json(settings.stats_path, render_s))
+        std::cerr << "Stats written to " << settings.stats_path << "\n";
+    if (!settings.heatmap_path.empty()) {
+        for (size_t p = 0; p < heat.size(); ++p) heat[p] /= std::max<uint32_t>(progress.samples[p], 1);
+        double top = write_heatmap(settings.heatmap_path, heat, width, height);
+        std::cerr << "Heatmap " << settings.heatmap_path << ": red = " << top << " nodes + tests per sample\n";
     }
+#else
+    if (!settings.heatmap_path.empty())
+        std::cerr << "--heatmap needs a build with -DRT_STATS; skipped\n";
+#endif
 
-    file.write(reinterpret_cast<const char*>(out.data()), out.size());
-    file.close();
     return 0;
 }
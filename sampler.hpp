@@ -0,0 +1,232 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counter-based samplers.
+// Every value is a pure function of (seed, pixel, sample index, dimension),
+// so a pixel sample draws the same numbers no matter which thread renders
+// it, in which order, or on which machine. Tiles rendered elsewhere with the
+// same seed can be merged sample-for-sample.
+//
+// Independent draws hashed white noise. Sobol and Halton draw
+// low-discrepancy points: across the samples of one pixel, each dimension
+// (and each 2D pair from next_2d) is stratified, so estimates converge
+// faster. Both are Owen-scrambled with a per-pixel seed, which keeps them
+// unbiased and decorrelates neighbouring pixels. For that to pay off a
+// dimension must mean the same thing in every sample, see PathDims.
+enum class SamplerType : uint8_t {
+    Independent,
+    Sobol,      // one shuffled 2D Sobol pattern per draw (Burley 2020)
+    Halton,     // one prime base per dimension
+};
+
+inline const char* sampler_name(SamplerType t) {
+    switch (t) {
+    case SamplerType::Sobol:  return "sobol";
+    case SamplerType::Halton: return "halton";
+    default:                  return "independent";
+    }
+}
+
+inline bool parse_sampler_type(const std::string& s, SamplerType& out) {
+    if      (s == "independent") out = SamplerType::Independent;
+    else if (s == "sobol")       out = SamplerType::Sobol;
+    else if (s == "halton")      out = SamplerType::Halton;
+    else return false;
+    return true;
+}
+
+struct Sample2 { double u, v; };
+
+class Sampler {
+public:
+    explicit Sampler(uint64_t seed = 0, SamplerType type = SamplerType::Independent)
+        : seed(seed), type(type) {}
+
+    // Restart the stream of the given pixel sample at dimension `first_dim`
+    void start(uint64_t pixel, uint32_t sample_index, uint32_t first_dim = 0) {
+        pixel_key = mix(seed ^ mix(pixel + 0x9E3779B97F4A7C15ULL));
+        key = mix(pixel_key + sample_index);
+        index = sample_index;
+        reversed_index = reverse_bits(sample_index);
+        dim = first_dim;
+    }
+
+    uint32_t dimension() const { return dim; }
+    void seek(uint32_t first_dim) { dim = first_dim; }
+
+    // Uniform in [0,1), consumes one dimension
+    double next_1d() {
+        const uint32_t d = dim++;
+        switch (type) {
+        case SamplerType::Sobol: {
+            const uint64_t h = draw_hash(d);
+            return to_unit(reverse_bits(laine_karras(shuffled_index(uint32_t(h)), uint32_t(h >> 32))));
+        }
+        case SamplerType::Halton:
+            if (d < HALTON_DIMS) return owen_radical_inverse(index, primes()[d], draw_hash(d));
+            break;
+        case SamplerType::Independent:
+            break;
+        }
+        return white(d);
+    }
+    double next_1d(double min, double max) { return min + (max - min) * next_1d(); }
+
+    // A point in [0,1)^2, consumes two dimensions
+    Sample2 next_2d() {
+        if (type == SamplerType::Sobol) {
+            const uint32_t d = dim;
+            dim += 2;
+            const uint64_t h = draw_hash(d);
+            const uint32_t i = shuffled_index(uint32_t(h));
+            return {to_unit(reverse_bits(laine_karras(i, uint32_t(h >> 32)))),
+                    to_unit(reverse_bits(laine_karras(sobol_dim1_reversed(i), uint32_t((h * 0x9E3779B97F4A7C15ULL) >> 32))))};
+        }
+        return {next_1d(), next_1d()};
+    }
+
+private:
+    static constexpr uint32_t HALTON_DIMS = 1024;   // white noise beyond
+
+    uint64_t seed;
+    SamplerType type;
+    uint64_t pixel_key = 0;
+    uint64_t key = 0;
+    uint32_t index = 0;
+    uint32_t reversed_index = 0;
+    uint32_t dim = 0;
+
+    // splitmix64 / PCG-style 64-bit finaliser
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double white(uint32_t d) const {
+        uint64_t bits = mix(key + uint64_t(d) * 0x9E3779B97F4A7C15ULL);
+        return (bits >> 11) * (1.0 / 9007199254740992.0); // 53 bits
+    }
+
+    static double to_unit(uint32_t x) { return x * (1.0 / 4294967296.0); }
+
+    // Scrambling seeds of one draw in this pixel
+    uint64_t draw_hash(uint32_t d) const { return mix(pixel_key ^ (uint64_t(d) << 32)); }
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+        x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+        return x;
+    }
+
+    // Owen scrambling in base 2, on bit-reversed values (the most
+    // significant binary digit in bit 0): every bit is flipped by a hash of
+    // the bits below it. Laine-Karras style hash with Burley's constants.
+    static uint32_t laine_karras(uint32_t x, uint32_t s) {
+        x ^= x * 0x3D20ADEAu;
+        x += s;
+        x *= (s >> 16) | 1u;
+        x ^= x * 0x05526C56u;
+        x ^= x * 0x53A22864u;
+        return x;
+    }
+
+    // The sample index, Owen-scrambled per pixel and draw: every draw visits
+    // the same well-stratified points, in its own order (Burley 2020)
+    uint32_t shuffled_index(uint32_t s) const { return reverse_bits(laine_karras(reversed_index, s)); }
+
+    // Second Sobol dimension, bit-reversed (the first is the reversed index
+    // itself). Its generator matrix is Pascal's triangle mod 2: output digit
+    // m is the parity of the index bits k with m a subset of k, a superset
+    // transform over the 5-bit positions.
+    static uint32_t sobol_dim1_reversed(uint32_t i) {
+        i ^= (i >> 1)  & 0x55555555u;
+        i ^= (i >> 2)  & 0x33333333u;
+        i ^= (i >> 4)  & 0x0F0F0F0Fu;
+        i ^= (i >> 8)  & 0x00FF00FFu;
+        i ^= (i >> 16) & 0x0000FFFFu;
+        return i;
+    }
+
+    // Radical inverse of `a` in `base` with Owen scrambling: each digit goes
+    // through a random permutation picked by a hash of the seed and the
+    // digits before it. Past the index's last digit every digit is a
+    // scrambled zero, i.e. uniform, so the tail is one uniform offset.
+    static double owen_radical_inverse(uint32_t a, uint32_t base, uint64_t s) {
+        const double inv_base = 1.0 / base;
+        uint64_t node = s;
+        double value = 0.0, scale = 1.0;
+        for (; a; a /= base) {
+            const uint32_t digit = a % base;
+            scale *= inv_base;
+            value += double(permute(digit, base, uint32_t(node))) * scale;
+            node = mix(node + digit + 1);
+        }
+        value += scale * ((node >> 11) * (1.0 / 9007199254740992.0));
+        return value < 1.0 ? value : 0x1.fffffffffffffp-1;
+    }
+
+    // Element i of a pseudo-random permutation of [0, n) chosen by p
+    // (Kensler, "Correlated Multi-Jittered Sampling")
+    static uint32_t permute(uint32_t i, uint32_t n, uint32_t p) {
+        uint32_t w = n - 1;
+        w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+        do {
+            i ^= p;       i *= 0xE170893Du;
+            i ^= p >> 16; i ^= (i & w) >> 4;
+            i ^= p >> 8;  i *= 0x0929EB3Fu;
+            i ^= p >> 23; i ^= (i & w) >> 1;
+            i *= 1u | p >> 27;
+            i *= 0x6935FA69u;
+            i ^= (i & w) >> 11; i *= 0x74DCB303u;
+            i ^= (i & w) >> 2;  i *= 0x9E501CC3u;
+            i ^= (i & w) >> 2;  i *= 0xC860A3DFu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= n);
+        return (i + p) % n;
+    }
+
+    static const uint32_t* primes() {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> p;
+            for (uint32_t n = 2; p.size() < HALTON_DIMS; ++n) {
+                bool prime = true;
+                for (uint32_t q : p) {
+                    if (q * q > n) break;
+                    if (n % q == 0) { prime = false; break; }
+                }
+                if (prime) p.push_back(n);
+            }
+            return p;
+        }();
+        return table.data();
+    }
+};
+
+// Dimension layout of a path. The camera ray takes the first CAMERA
+// dimensions (film position, lens, time); then every bounce owns a block:
+// scattering, Russian roulette, then its light and BRDF samples. Integrators
+// seek() to each step's offset, so a dimension means the same thing in every
+// sample whatever the path did before, e.g. a glass hit drawing one value
+// where a metal one draws three.
+struct PathDims {
+    static constexpr uint32_t CAMERA   = 5;
+    static constexpr uint32_t SCATTER  = 3;   // the most any material draws (metal fuzz)
+    static constexpr uint32_t ROULETTE = 1;
+    static constexpr uint32_t LIGHT    = 3;   // light pick + point on the light
+    static constexpr uint32_t BRDF     = 2;
+
+    uint32_t light_samples = 1, brdf_samples = 1;
+
+    uint32_t per_bounce() const { return SCATTER + ROULETTE + light_samples * LIGHT + brdf_samples * BRDF; }
+    uint32_t scatter(int bounce) const { return CAMERA + uint32_t(bounce) * per_bounce(); }
+    uint32_t roulette(int bounce) const { return scatter(bounce) + SCATTER; }
+    uint32_t light(int bounce, int s) const { return roulette(bounce) + ROULETTE + uint32_t(s) * LIGHT; }
+    uint32_t brdf(int bounce, int s) const { return light(bounce, int(light_samples)) + uint32_t(s) * BRDF; }
+};
@@ -0,0 +1,180 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+#include "hittable.hpp"
+#include "material.hpp"
+#include "bvh.hpp"
+#include "linear_bvh.hpp"
+#include "wide_bvh.hpp"
+#include "packet.hpp"
+#include "mapped_file.hpp"
+#include "lights.hpp"
+#include "sphere.hpp"
+#include "xy_rect.hpp"
+#include "xz_rect.hpp"
+#include "yz_rect.hpp"
+#include "triangle_mesh.hpp"
+#include "instance.hpp"
+
+// Owns everything a render reads: the material table, the primitives, the
+// emitters and the acceleration structures over them. Hit records refer to
+// materials by index and BVHs hold raw primitive pointers, so nothing on the
+// intersection path touches a reference count. The Scene must outlive the
+// render.
+class Scene {
+public:
+    std::unique_ptr<MappedFile> mapped; // backs zero-copy mesh buffers from a cache (declared first, freed last)
+    std::vector<Material> materials;
+    std::vector<std::unique_ptr<Hittable>> geometries; // bottom-level geometry shared by Instances, never traced directly
+    std::vector<std::unique_ptr<Hittable>> objects;
+    std::unique_ptr<LinearBVH> flat;    // top-level BVH over `objects`
+    std::unique_ptr<Hittable>  wide;    // optional 4/8-wide BVH collapsed from `flat`
+    const Hittable* accel = nullptr;    // what rays traverse: flat or wide
+    LightSet lights;                    // every emissive surface, see collect_lights()
+
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+    Scene(Scene&&) = default;
+    Scene& operator=(Scene&&) = default;
+
+    MaterialId add_material(const Material& m) {
+        materials.push_back(m);
+        return MaterialId(materials.size() - 1);
+    }
+
+    template <class T, class... Args>
+    T& add(Args&&... args) {
+        auto obj = std::make_unique<T>(std::forward<Args>(args)...);
+        T& ref = *obj;
+        objects.push_back(std::move(obj));
+        return ref;
+    }
+
+    // Geometry that is only rendered through instances of it
+    template <class T, class... Args>
+    T& add_geometry(Args&&... args) {
+        auto g = std::make_unique<T>(std::forward<Args>(args)...);
+        T& ref = *g;
+        geometries.push_back(std::move(g));
+        return ref;
+    }
+
+    Instance& add_instance(const Hittable& geometry, const Transform& xf) {
+        return add<Instance>(geometry, xf);
+    }
+
+    // (Re)builds `flat` over `objects`. Bottom-level BVHs (meshes, instanced
+    // geometry) are left alone, so after moving instances this is the only
+    // rebuild needed; call build_accel() again afterwards.
+    void build_top_level(const BVHBuildOptions& opts, BVHBuildStats* stats = nullptr) {
+        std::vector<const Hittable*> prims = primitives();
+        BVHNode tree(prims, 0, prims.size(), opts, stats);
+        flat = std::make_unique<LinearBVH>(tree);
+        top_opts = opts;
+        built_cost = flat->sah_cost(opts);
+    }
+
+    // Refits `flat` and the wide BVH over it in place, after animation has
+    // moved primitives or instances (emitters must stay put: lights are not
+    // recollected). Returns the refit tree's SAH cost relative to the cost
+    // right after the last build_top_level(), so callers can rebuild once
+    // the kept topology has degraded too far.
+    double refit_top_level() {
+        flat->refit();
+        if      (wide_width == 8) static_cast<WideBVH<8>&>(*wide).refit(*flat);
+        else if (wide_width == 4) static_cast<WideBVH<4>&>(*wide).refit(*flat);
+        return built_cost > 0.0 ? flat->sah_cost(top_opts) / built_cost : 1.0;
+    }
+
+    // Picks the traversal structure once `flat` exists: 2 => flat itself,
+    // 4/8 => a wide BVH using the given box-test kernels
+    void build_accel(int width, SimdLevel simd) {
+        if      (width == 8) wide = std::make_unique<WideBVH<8>>(*flat, simd);
+        else if (width == 4) wide = std::make_unique<WideBVH<4>>(*flat, simd);
+        else                 wide.reset();
+        wide_width = wide ? width : 2;
+        accel = wide ? wide.get() : static_cast<const Hittable*>(flat.get());
+    }
+
+    // Gathers every primitive with an emissive material into `lights`
+    // (spheres, rects of any orientation and each triangle of a mesh) and
+    // tags the primitives with their light index for MIS on BSDF samples
+    void collect_lights(LightSelect how) {
+        lights.lights.clear();
+        for (auto& obj : objects) {
+            Hittable* h = obj.get();
+            auto next = [&]() { return uint32_t(lights.lights.size()); };
+            if (auto* s = dynamic_cast<Sphere*>(h)) {
+                if (!material(s->mat).is_emissive()) continue;
+                s->light = next();
+                lights.lights.push_back(Light::sphere(s->center, s->radius, material(s->mat).radiance()));
+            } else if (auto* r = dynamic_cast<XYRect*>(h)) {
+                if (!material(r->mat).is_emissive()) continue;
+                r->light = next();
+                lights.lights.push_back(Light::rect(Vec3(r->x0, r->y0, r->k), Vec3(r->x1 - r->x0, 0, 0),
+                                                    Vec3(0, r->y1 - r->y0, 0), material(r->mat).radiance()));
+            } else if (auto* r = dynamic_cast<XZRect*>(h)) {
+                if (!material(r->mat).is_emissive()) continue;
+                r->light = next();
+                lights.lights.push_back(Light::rect(Vec3(r->x0, r->k, r->z0), Vec3(r->x1 - r->x0, 0, 0),
+                                                    Vec3(0, 0, r->z1 - r->z0), material(r->mat).radiance()));
+            } else if (auto* r = dynamic_cast<YZRect*>(h)) {
+                if (!material(r->mat).is_emissive()) continue;
+                r->light = next();
+                lights.lights.push_back(Light::rect(Vec3(r->k, r->y0, r->z0), Vec3(0, r->y1 - r->y0, 0),
+                                                    Vec3(0, 0, r->z1 - r->z0), material(r->mat).radiance()));
+            } else if (auto* m = dynamic_cast<TriangleMesh*>(h)) {
+                if (!material(m->mat).is_emissive()) continue;
+                m->light_base = next();
+                Vec3 le = material(m->mat).radiance();
+                for (size_t t = 0; t < m->triangle_count(); ++t) {
+                    const uint32_t* v = &m->view.indices[3 * t];
+                    lights.lights.push_back(Light::triangle(m->vertex(v[0]), m->vertex(v[1]), m->vertex(v[2]), le));
+                }
+            }
+        }
+        lights.build(how);
+    }
+
+    const Material& material(MaterialId id) const { return materials[id]; }
+
+    // Non-owning view of `objects`, in insertion order
+    std::vector<const Hittable*> primitives() const {
+        std::vector<const Hittable*> out;
+        out.reserve(objects.size());
+        for (const auto& o : objects) out.push_back(o.get());
+        return out;
+    }
+
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+        return accel->hit(r, t_min, t_max, rec);
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const {
+        return accel->occluded(r, t_min, t_max);
+    }
+
+    // Packet queries walk `flat` (packets bring their own SIMD width, so the
+    // wide BVH buys nothing); packets whose lanes do not share a direction
+    // octant fall back to tracing each lane through `accel`
+    uint32_t hit_lanes(const PacketQuery& q, Real* t_max, HitRecord* rec) const {
+        return with_packet(q, t_max, [&](auto& P) -> uint32_t {
+            if (!P.coherent || flat->nodes.empty()) return accel->Hittable::hit_lanes(q, t_max, rec);
+            return packet_hit(flat->nodes.data(), flat->prims.data(), P, q, t_max, rec);
+        });
+    }
+
+    uint32_t occluded_lanes(const PacketQuery& q, const Real* t_max) const {
+        return with_packet(q, t_max, [&](auto& P) -> uint32_t {
+            if (!P.coherent || flat->nodes.empty()) return accel->Hittable::occluded_lanes(q, t_max);
+            return packet_occluded(flat->nodes.data(), flat->prims.data(), P, q, t_max);
+        });
+    }
+
+private:
+    BVHBuildOptions top_opts;   // what `flat` was last built with
+    double built_cost = 0.0;    // its SAH cost at that build
+    int    wide_width = 2;      // 4/8 when `wide` holds a WideBVH of that width
+};
@@ -0,0 +1,351 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hittable.hpp"
+#include "linear_bvh.hpp"
+#include "mapped_file.hpp"
+#include "scene.hpp"
+#include "triangle_mesh.hpp"
+#include "sphere.hpp"
+#include "xy_rect.hpp"
+#include "xz_rect.hpp"
+#include "yz_rect.hpp"
+#include "material.hpp"
+
+// Binary scene cache: the flattened geometry, the material table and the
+// built top-level and per-mesh BVHs in one versioned file. Loading maps the
+// file and points mesh buffers straight into it, so a repeat render skips
+// parsing and BVH construction. The header carries a hash of the source
+// scene; any mismatch means "rebuild".
+
+static constexpr uint32_t SCENE_CACHE_VERSION = 2;
+
+// 64-bit content hash (multiply-xorshift over 8-byte words)
+inline uint64_t hash_bytes(const void* data, size_t n, uint64_t seed = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (0x9E3779B97F4A7C15ULL * (n + 1));
+    auto mix = [](uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = mix(h ^ w) + 0x632BE59BD9B4E019ULL;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p + i, n - i);
+    return mix(h ^ tail);
+}
+
+enum class CachedPrim     : uint32_t { Sphere, XYRect, XZRect, YZRect, Mesh };
+
+struct MaterialRecord {
+    uint32_t type;     // MaterialType
+    uint32_t pad;
+    double   p[4];     // color, param
+};
+
+struct PrimRecord {
+    uint32_t kind;
+    uint32_t material;
+    uint32_t mesh;     // index into the mesh table (meshes only)
+    uint32_t pad;
+    double   p[6];
+};
+
+struct MeshRecord {
+    uint64_t px, py, pz, indices, nodes; // file offsets
+    uint64_t num_vertices, num_indices, num_nodes;
+};
+
+struct SceneCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t endian;     // 0x01020304 as written by the producing host
+    uint64_t scene_hash;
+    uint64_t file_size;
+    uint64_t material_offset, material_count;
+    uint64_t prim_offset,     prim_count;
+    uint64_t mesh_offset,     mesh_count;
+    uint64_t node_offset,     node_count;  // top-level LinearBVH
+    uint64_t order_offset,    order_count; // top-level leaf slot -> prim record
+};
+
+// Plain-data description of a scene: the part that is hashed and written
+struct SceneTables {
+    std::vector<MaterialRecord> materials;
+    std::vector<PrimRecord> prims;
+    std::vector<const TriangleMesh*> meshes;
+};
+
+// Records the material table and every object; fails on primitive types
+// the cache cannot express
+inline bool describe_scene(const Scene& scene, SceneTables& out) {
+    for (const Material& m : scene.materials) {
+        MaterialRecord rec{};
+        rec.type = uint32_t(m.type);
+        rec.p[0] = m.color.x; rec.p[1] = m.color.y; rec.p[2] = m.color.z; rec.p[3] = m.param;
+        out.materials.push_back(rec);
+    }
+
+    for (const auto& obj : scene.objects) {
+        PrimRecord rec{};
+        if (auto* s = dynamic_cast<const Sphere*>(obj.get())) {
+            rec.kind = uint32_t(CachedPrim::Sphere);
+            rec.p[0] = s->center.x; rec.p[1] = s->center.y; rec.p[2] = s->center.z; rec.p[3] = s->radius;
+            rec.material = s->mat;
+        } else if (auto* r = dynamic_cast<const XYRect*>(obj.get())) {
+            rec.kind = uint32_t(CachedPrim::XYRect);
+            rec.p[0] = r->x0; rec.p[1] = r->x1; rec.p[2] = r->y0; rec.p[3] = r->y1; rec.p[4] = r->k;
+            rec.material = r->mat;
+        } else if (auto* r = dynamic_cast<const XZRect*>(obj.get())) {
+            rec.kind = uint32_t(CachedPrim::XZRect);
+            rec.p[0] = r->x0; rec.p[1] = r->x1; rec.p[2] = r->z0; rec.p[3] = r->z1; rec.p[4] = r->k;
+            rec.material = r->mat;
+        } else if (auto* r = dynamic_cast<const YZRect*>(obj.get())) {
+            rec.kind = uint32_t(CachedPrim::YZRect);
+            rec.p[0] = r->y0; rec.p[1] = r->y1; rec.p[2] = r->z0; rec.p[3] = r->z1; rec.p[4] = r->k;
+            rec.material = r->mat;
+        } else if (auto* m = dynamic_cast<const TriangleMesh*>(obj.get())) {
+            rec.kind = uint32_t(CachedPrim::Mesh);
+            rec.mesh = uint32_t(out.meshes.size());
+            out.meshes.push_back(m);
+            rec.material = m->mat;
+        } else {
+            return false;
+        }
+        out.prims.push_back(rec);
+    }
+    return true;
+}
+
+// Hash of the scene records (mesh records only say "a mesh goes here"; the
+// caller mixes in a hash of the mesh sources)
+inline uint64_t hash_scene(const SceneTables& t, uint64_t seed = 0) {
+    uint64_t h = hash_bytes(&SCENE_CACHE_VERSION, sizeof(SCENE_CACHE_VERSION), seed);
+    h = hash_bytes(t.materials.data(), t.materials.size() * sizeof(MaterialRecord), h);
+    return hash_bytes(t.prims.data(), t.prims.size() * sizeof(PrimRecord), h);
+}
+
+// Writes scene.objects, its materials and scene.flat
+inline bool write_scene_cache(const std::string& path, uint64_t scene_hash, const Scene& scene) {
+    SceneTables t;
+    if (!scene.flat || !describe_scene(scene, t)) {
+        std::cerr << "scene cache: scene has types the cache cannot store\n";
+        return false;
+    }
+
+    std::unordered_map<const Hittable*, uint32_t> prim_index;
+    for (size_t i = 0; i < scene.objects.size(); ++i) prim_index[scene.objects[i].get()] = uint32_t(i);
+    const LinearBVH& top = *scene.flat;
+    std::vector<uint32_t> order;
+    for (const Hittable* p : top.prims) {
+        auto it = prim_index.find(p);
+        if (it == prim_index.end()) { std::cerr << "scene cache: BVH references unknown object\n"; return false; }
+        order.push_back(it->second);
+    }
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) { std::cerr << "scene cache: cannot write " << tmp << "\n"; return false; }
+
+    uint64_t pos = 0;
+    auto put = [&](const void* data, size_t n) {
+        out.write(static_cast<const char*>(data), std::streamsize(n));
+        pos += n;
+    };
+    auto align = [&]() { // every section starts on a cache line
+        static const char zeros[64] = {};
+        if (pos % 64) put(zeros, 64 - pos % 64);
+        return pos;
+    };
+    auto section = [&](const void* data, size_t n) {
+        uint64_t at = align();
+        put(data, n);
+        return at;
+    };
+
+    SceneCacheHeader h{};
+    std::memcpy(h.magic, "RTCACHE", 8);
+    h.version = SCENE_CACHE_VERSION;
+    h.endian = 0x01020304u;
+    h.scene_hash = scene_hash;
+    put(&h, sizeof(h));
+
+    std::vector<MeshRecord> meshes(t.meshes.size());
+    for (size_t i = 0; i < t.meshes.size(); ++i) {
+        const MeshView& v = t.meshes[i]->view;
+        MeshRecord& m = meshes[i];
+        m.num_vertices = v.num_vertices;
+        m.num_indices  = v.num_indices;
+        m.num_nodes    = v.num_nodes;
+        m.px      = section(v.px, v.num_vertices * sizeof(float));
+        m.py      = section(v.py, v.num_vertices * sizeof(float));
+        m.pz      = section(v.pz, v.num_vertices * sizeof(float));
+        m.indices = section(v.indices, v.num_indices * sizeof(uint32_t));
+        m.nodes   = section(v.nodes, v.num_nodes * sizeof(LinearBVHNode));
+    }
+    h.material_offset = section(t.materials.data(), t.materials.size() * sizeof(MaterialRecord));
+    h.material_count  = t.materials.size();
+    h.prim_offset     = section(t.prims.data(), t.prims.size() * sizeof(PrimRecord));
+    h.prim_count      = t.prims.size();
+    h.mesh_offset     = section(meshes.data(), meshes.size() * sizeof(MeshRecord));
+    h.mesh_count      = meshes.size();
+    h.node_offset     = section(top.nodes.data(), top.nodes.size() * sizeof(LinearBVHNode));
+    h.node_count      = top.nodes.size();
+    h.order_offset    = section(order.data(), order.size() * sizeof(uint32_t));
+    h.order_count     = order.size();
+    h.file_size       = pos;
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.close();
+    if (!out) { std::cerr << "scene cache: write failed\n"; return false; }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Structural check of a flattened BVH read from disk: every child lies after
+// its parent and inside the array, the split axis is 0-2, every leaf range
+// fits in `prim_count`, and no path is deeper than the traversal stacks (64)
+inline bool valid_linear_bvh(const LinearBVHNode* nodes, uint64_t count, uint64_t prim_count) {
+    std::vector<uint8_t> depth(count, 0);
+    for (uint64_t i = 0; i < count; ++i) {
+        const LinearBVHNode& n = nodes[i];
+        if (n.count > 0) {
+            if (n.offset > prim_count || n.count > prim_count - n.offset) return false;
+            continue;
+        }
+        if (n.axis > 2 || i + 1 >= count || n.offset <= i || n.offset >= count || depth[i] >= 63) return false;
+        const uint8_t d = uint8_t(depth[i] + 1);
+        depth[i + 1] = std::max(depth[i + 1], d);
+        depth[n.offset] = std::max(depth[n.offset], d);
+    }
+    return true;
+}
+
+// Loads a cache written for `scene_hash` into a fresh Scene (accel is left
+// for the caller); returns false (quietly, unless the file is damaged) when
+// there is no usable cache
+inline bool load_scene_cache(const std::string& path, uint64_t scene_hash, Scene& out) {
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(path) || file->size() < sizeof(SceneCacheHeader)) return false;
+
+    SceneCacheHeader h;
+    std::memcpy(&h, file->data(), sizeof(h));
+    if (std::memcmp(h.magic, "RTCACHE", 8) != 0 || h.version != SCENE_CACHE_VERSION ||
+        h.endian != 0x01020304u || h.scene_hash != scene_hash)
+        return false;
+
+    const char* base = file->data();
+    auto in_file = [&](uint64_t offset, uint64_t count, size_t elem) {
+        return offset <= file->size() && count <= (file->size() - offset) / elem;
+    };
+    if (h.file_size != file->size() ||
+        !in_file(h.material_offset, h.material_count, sizeof(MaterialRecord)) ||
+        !in_file(h.prim_offset, h.prim_count, sizeof(PrimRecord)) ||
+        !in_file(h.mesh_offset, h.mesh_count, sizeof(MeshRecord)) ||
+        !in_file(h.node_offset, h.node_count, sizeof(LinearBVHNode)) ||
+        !in_file(h.order_offset, h.order_count, sizeof(uint32_t))) {
+        std::cerr << "scene cache: " << path << " is damaged, rebuilding\n";
+        return false;
+    }
+
+    auto* mats   = reinterpret_cast<const MaterialRecord*>(base + h.material_offset);
+    auto* prims  = reinterpret_cast<const PrimRecord*>(base + h.prim_offset);
+    auto* meshes = reinterpret_cast<const MeshRecord*>(base + h.mesh_offset);
+    auto* nodes  = reinterpret_cast<const LinearBVHNode*>(base + h.node_offset);
+    auto* order  = reinterpret_cast<const uint32_t*>(base + h.order_offset);
+
+    Scene scene;
+    for (uint64_t i = 0; i < h.material_count; ++i) {
+        const MaterialRecord& m = mats[i];
+        switch (MaterialType(m.type)) {
+        case MaterialType::Lambertian:
+        case MaterialType::Metal:
+        case MaterialType::Dielectric:
+        case MaterialType::DiffuseLight:
+            scene.add_material({MaterialType(m.type), Vec3(m.p[0], m.p[1], m.p[2]), m.p[3]});
+            break;
+        default:
+            std::cerr << "scene cache: unknown material type\n";
+            return false;
+        }
+    }
+
+    for (uint64_t i = 0; i < h.prim_count; ++i) {
+        const PrimRecord& p = prims[i];
+        if (p.material >= scene.materials.size()) { std::cerr << "scene cache: bad material index\n"; return false; }
+        const MaterialId mat = p.material;
+        switch (CachedPrim(p.kind)) {
+        case CachedPrim::Sphere:
+            scene.add<Sphere>(Vec3(p.p[0], p.p[1], p.p[2]), p.p[3], mat); break;
+        case CachedPrim::XYRect:
+            scene.add<XYRect>(p.p[0], p.p[1], p.p[2], p.p[3], p.p[4], mat); break;
+        case CachedPrim::XZRect:
+            scene.add<XZRect>(p.p[0], p.p[1], p.p[2], p.p[3], p.p[4], mat); break;
+        case CachedPrim::YZRect:
+            scene.add<YZRect>(p.p[0], p.p[1], p.p[2], p.p[3], p.p[4], mat); break;
+        case CachedPrim::Mesh: {
+            if (p.mesh >= h.mesh_count) { std::cerr << "scene cache: bad mesh index\n"; return false; }
+            const MeshRecord& m = meshes[p.mesh];
+            if (!in_file(m.px, m.num_vertices, sizeof(float)) || !in_file(m.py, m.num_vertices, sizeof(float)) ||
+                !in_file(m.pz, m.num_vertices, sizeof(float)) ||
+                !in_file(m.indices, m.num_indices, sizeof(uint32_t)) ||
+                !in_file(m.nodes, m.num_nodes, sizeof(LinearBVHNode)) || m.num_indices % 3 != 0 ||
+                !valid_linear_bvh(reinterpret_cast<const LinearBVHNode*>(base + m.nodes), m.num_nodes,
+                                  m.num_indices / 3)) {
+                std::cerr << "scene cache: " << path << " is damaged, rebuilding\n";
+                return false;
+            }
+            auto* idx = reinterpret_cast<const uint32_t*>(base + m.indices);
+            for (uint64_t k = 0; k < m.num_indices; ++k) {
+                if (idx[k] >= m.num_vertices) {
+                    std::cerr << "scene cache: " << path << " is damaged, rebuilding\n";
+                    return false;
+                }
+            }
+            MeshView v;
+            v.px = reinterpret_cast<const float*>(base + m.px);
+            v.py = reinterpret_cast<const float*>(base + m.py);
+            v.pz = reinterpret_cast<const float*>(base + m.pz);
+            v.indices = idx;
+            v.nodes = reinterpret_cast<const LinearBVHNode*>(base + m.nodes);
+            v.num_vertices = m.num_vertices;
+            v.num_indices = m.num_indices;
+            v.num_nodes = m.num_nodes;
+            scene.add<TriangleMesh>(v, mat);
+            break;
+        }
+        default:
+            std::cerr << "scene cache: unknown primitive kind\n";
+            return false;
+        }
+    }
+
+    if (!valid_linear_bvh(nodes, h.node_count, h.order_count)) {
+        std::cerr << "scene cache: " << path << " is damaged, rebuilding\n";
+        return false;
+    }
+    std::vector<const Hittable*> ordered;
+    ordered.reserve(h.order_count);
+    for (uint64_t i = 0; i < h.order_count; ++i) {
+        if (order[i] >= scene.objects.size()) { std::cerr << "scene cache: bad BVH order\n"; return false; }
+        ordered.push_back(scene.objects[order[i]].get());
+    }
+    scene.flat = std::make_unique<LinearBVH>(std::vector<LinearBVHNode>(nodes, nodes + h.node_count),
+                                             std::move(ordered));
+    scene.mapped = std::move(file);
+    out = std::move(scene);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+
+// x86 SIMD support: kernels are compiled with per-function target attributes
+// and chosen at runtime, so one binary runs everywhere and still uses AVX2
+// where the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RT_X86_SIMD 1
+#include <immintrin.h>
+#define RT_TARGET_SSE  __attribute__((target("sse4.1")))
+#define RT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+// AVX2 without FMA, for kernels that must round exactly like their scalar
+// version: with FMA enabled GCC fuses a*b+c chains (inlined scalar code
+// included) into single-rounding vfmadd
+#define RT_TARGET_AVX2_EXACT __attribute__((target("avx2")))
+#else
+#define RT_X86_SIMD 0
+#endif
+
+enum class SimdLevel { Scalar, SSE, AVX2 };
+
+inline SimdLevel detect_simd() {
+#if RT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))   return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return SimdLevel::SSE;
+#endif
+    return SimdLevel::Scalar;
+}
+
+inline const char* simd_name(SimdLevel s) {
+    switch (s) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE:  return "sse";
+    default:              return "scalar";
+    }
+}
+
+// "auto" resolves to the best level the CPU supports; an explicit request is
+// capped at that level too.
+inline bool parse_simd_level(const std::string& s, SimdLevel& out) {
+    SimdLevel best = detect_simd();
+    if      (s == "auto")   out = best;
+    else if (s == "scalar") out = SimdLevel::Scalar;
+    else if (s == "sse")    out = SimdLevel::SSE;
+    else if (s == "avx2")   out = SimdLevel::AVX2;
+    else return false;
+    if (int(out) > int(best)) out = best;
+    return true;
+}
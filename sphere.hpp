@@ -1,43 +1,57 @@
 #pragma once
-#include <memory>
 #include "hittable.hpp"
 
 class Sphere : public Hittable {
 public:
     Vec3 center;
-    double radius;
-    std::shared_ptr<Material> mat;
-
-    Sphere(const Vec3& c, double r, std::shared_ptr<Material> m)
-        : center(c), radius(r), mat(std::move(m)) {}
-
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
-        Vec3 oc = r.origin - center;
-        double a = dot(r.direction, r.direction);
-        double half_b = dot(oc, r.direction);
-        double c = dot(oc, oc) - radius*radius;
-        double discriminant = half_b*half_b - a*c;
-        if (discriminant < 0) return false;
+    Real radius;
+    MaterialId mat;
+    uint32_t light = NO_LIGHT; // set when the scene collects emitters
 
-        double sqrt_d = std::sqrt(discriminant);
+    Sphere(const Vec3& c, Real r, MaterialId m)
+        : center(c), radius(r), mat(m) {}
 
-        double root = (-half_b - sqrt_d) / a;
-        if (root < t_min || root > t_max) {
-            root = (-half_b + sqrt_d) / a;
-            if (root < t_min || root > t_max) return false;
-        }
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        Real root;
+        if (!intersect(r, center, t_min, t_max, root)) return false;
 
-        rec.t = root;
-        rec.point = r.at(rec.t);
-        Vec3 outward_normal = (rec.point - center) / radius;
+        rec.set_point(r, root);
+        // Snap onto the sphere: the quadratic's root can lose digits, this cannot
+        Vec3 outward_normal = normalize(rec.point - center);
+        rec.point = center + radius * outward_normal;
         rec.set_face_normal(r, outward_normal);
         rec.mat = mat;
+        rec.light = light;
         return true;
     }
 
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        Real root;
+        return intersect(r, center, t_min, t_max, root);
+    }
+
     bool bounding_box(AABB& out_box) const override {
         Vec3 r(radius, radius, radius);
         out_box = AABB(center - r, center + r);
         return true;
     }
+
+private:
+    bool intersect(const Ray& r, const Vec3& c, Real t_min, Real t_max, Real& root) const {
+        Vec3 oc = r.origin - c;
+        Real a = dot(r.direction, r.direction);
+        Real half_b = dot(oc, r.direction);
+        Real cc = dot(oc, oc) - radius*radius;
+        Real discriminant = half_b*half_b - a*cc;
+        if (discriminant < 0) return false;
+
+        Real sqrt_d = std::sqrt(discriminant);
+
+        root = (-half_b - sqrt_d) / a;
+        if (root < t_min || root > t_max) {
+            root = (-half_b + sqrt_d) / a;
+            if (root < t_min || root > t_max) return false;
+        }
+        return true;
+    }
 };
@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Render statistics, compiled in only with -DRT_STATS. Every counter site is
+// wrapped in RT_STAT(...), which expands to nothing in a normal build, so the
+// instrumentation costs nothing unless asked for.
+//
+// Each thread counts into its own RenderStats (no atomics on the hot path);
+// the registry keeps them alive after pool threads exit and merges them once
+// the render is done.
+#ifdef RT_STATS
+#define RT_STAT(...) __VA_ARGS__
+#else
+#define RT_STAT(...)
+#endif
+
+#ifdef RT_STATS
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+static const int PATH_LENGTH_BINS = 32;
+
+struct TileTime {
+    int x0, y0, x1, y1;
+    double ms;
+};
+
+struct RenderStats {
+    uint64_t camera_rays   = 0;
+    uint64_t indirect_rays = 0;   // extension rays after the first bounce
+    uint64_t shadow_rays   = 0;   // NEE light samples (any-hit)
+    uint64_t probe_rays    = 0;   // NEE BRDF samples (closest hit)
+    uint64_t nodes_visited = 0;   // BVH nodes whose boxes a ray was tested against
+    uint64_t prim_tests    = 0;   // primitive (or triangle) intersection tests
+    uint64_t rr_terminations = 0;
+    uint64_t path_length[PATH_LENGTH_BINS] = {}; // segments a path traced before it ended; last bin is "or more"
+    std::vector<TileTime> tiles;
+
+    uint64_t rays() const { return camera_rays + indirect_rays + shadow_rays + probe_rays; }
+
+    void end_path(int segments) {
+        ++path_length[std::min(std::max(segments, 0), PATH_LENGTH_BINS - 1)];
+    }
+
+    void merge(const RenderStats& o) {
+        camera_rays     += o.camera_rays;
+        indirect_rays   += o.indirect_rays;
+        shadow_rays     += o.shadow_rays;
+        probe_rays      += o.probe_rays;
+        nodes_visited   += o.nodes_visited;
+        prim_tests      += o.prim_tests;
+        rr_terminations += o.rr_terminations;
+        for (int i = 0; i < PATH_LENGTH_BINS; ++i) path_length[i] += o.path_length[i];
+        tiles.insert(tiles.end(), o.tiles.begin(), o.tiles.end());
+    }
+
+    void print(std::ostream& os, double seconds) const {
+        const double n = double(std::max<uint64_t>(1, rays()));
+        os << "Stats: " << rays() << " rays in " << seconds << " s ("
+           << double(rays()) / (seconds * 1e6) << " Mrays/s)\n"
+           << "  camera " << camera_rays << ", indirect " << indirect_rays
+           << ", shadow " << shadow_rays << ", brdf probe " << probe_rays << "\n"
+           << "  per ray: " << double(nodes_visited) / n << " nodes, "
+           << double(prim_tests) / n << " primitive tests\n"
+           << "  russian roulette terminations: " << rr_terminations << "\n";
+
+        uint64_t paths = 0;
+        for (uint64_t c : path_length) paths += c;
+        os << "  path length:";
+        for (int i = 0; i < PATH_LENGTH_BINS; ++i)
+            if (path_length[i]) os << " " << i << (i == PATH_LENGTH_BINS - 1 ? "+" : "") << ":"
+                                   << 100.0 * double(path_length[i]) / double(std::max<uint64_t>(1, paths)) << "%";
+        os << "\n";
+
+        if (!tiles.empty()) {
+            double lo = tiles[0].ms, hi = tiles[0].ms, sum = 0.0;
+            for (const TileTime& t : tiles) { lo = std::min(lo, t.ms); hi = std::max(hi, t.ms); sum += t.ms; }
+            os << "  tiles: " << tiles.size() << ", " << lo << " / " << sum / double(tiles.size())
+               << " / " << hi << " ms (min / mean / max)\n";
+        }
+    }
+
+    bool write_json(const std::string& path, double seconds) const {
+        std::ofstream f(path);
+        if (!f) { std::cerr << "cannot write " << path << "\n"; return false; }
+        f << "{\n  \"seconds\": " << seconds
+          << ",\n  \"rays\": {\"camera\": " << camera_rays << ", \"indirect\": " << indirect_rays
+          << ", \"shadow\": " << shadow_rays << ", \"brdf_probe\": " << probe_rays
+          << ", \"total\": " << rays() << "}"
+          << ",\n  \"nodes_visited\": " << nodes_visited
+          << ",\n  \"primitive_tests\": " << prim_tests
+          << ",\n  \"rr_terminations\": " << rr_terminations
+          << ",\n  \"path_length\": [";
+        for (int i = 0; i < PATH_LENGTH_BINS; ++i) f << (i ? ", " : "") << path_length[i];
+        f << "],\n  \"tiles\": [";
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            const TileTime& t = tiles[i];
+            f << (i ? ",\n    " : "\n    ") << "{\"x0\": " << t.x0 << ", \"y0\": " << t.y0
+              << ", \"x1\": " << t.x1 << ", \"y1\": " << t.y1 << ", \"ms\": " << t.ms << "}";
+        }
+        f << (tiles.empty() ? "]" : "\n  ]") << "\n}\n";
+        return bool(f);
+    }
+};
+
+class StatsRegistry {
+public:
+    RenderStats* add() {
+        std::lock_guard<std::mutex> lock(m);
+        all.push_back(std::make_unique<RenderStats>());
+        return all.back().get();
+    }
+
+    RenderStats merged() {
+        std::lock_guard<std::mutex> lock(m);
+        RenderStats out;
+        for (const auto& s : all) out.merge(*s);
+        return out;
+    }
+
+private:
+    std::mutex m;
+    std::vector<std::unique_ptr<RenderStats>> all;
+};
+
+inline StatsRegistry& stats_registry() {
+    static StatsRegistry r;
+    return r;
+}
+
+inline RenderStats& thread_stats() {
+    thread_local RenderStats* mine = stats_registry().add();
+    return *mine;
+}
+
+// Traversal work done by this thread so far; differences of it give the
+// cost of individual rays for the heatmap
+inline uint64_t traversal_work() {
+    const RenderStats& s = thread_stats();
+    return s.nodes_visited + s.prim_tests;
+}
+
+#endif
+
+// Writes per-pixel values (row-major, top row first) as a false colour
+// PPM: black -> blue -> green -> yellow -> red, scaled so `top` is full red
+// (by default the 99th percentile). Used for traversal work (RT_STATS
+// builds) and for the samples adaptive sampling spent. Returns the value
+// that maps to red.
+inline double write_heatmap(const std::string& path, const std::vector<double>& work, int width, int height,
+                            double top = 0.0) {
+    if (top <= 0.0) {
+        std::vector<double> sorted(work);
+        size_t k = sorted.empty() ? 0 : std::min(sorted.size() - 1, size_t(0.99 * double(sorted.size())));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        top = sorted.empty() ? 1.0 : std::max(1e-9, sorted[k]);
+    }
+
+    static const double stops[5][3] = {{0,0,0}, {0,0,1}, {0,1,0}, {1,1,0}, {1,0,0}};
+    std::ofstream f(path, std::ios::binary);
+    if (!f) { std::cerr << "cannot write " << path << "\n"; return top; }
+    f << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double v = std::min(1.0, work[size_t(y) * width + x] / top) * 4.0;
+            int s = std::min(3, int(v));
+            double t = v - s;
+            for (int c = 0; c < 3; ++c)
+                row[size_t(x) * 3 + c] = (unsigned char)(255.0 * ((1 - t) * stops[s][c] + t * stops[s + 1][c]) + 0.5);
+        }
+        f.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return top;
+}
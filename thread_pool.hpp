@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing thread pool.
+// Every worker owns a deque of task indices: it pops from the front of its own
+// queue and, once that runs dry, steals from the back of the other queues.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < threads; ++i) workers.emplace_back([this, i]{ worker_loop(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return unsigned(workers.size()); }
+
+    // Runs fn(task, worker) for every task in [0, count) and blocks until all
+    // of them have finished. Tasks are dealt round-robin in index order, so
+    // low indices start first no matter how many workers there are.
+    void run(size_t count, const std::function<void(size_t, unsigned)>& fn) {
+        if (count == 0) return;
+        std::unique_lock<std::mutex> lock(mutex);
+        remaining = count;
+        for (size_t t = 0; t < count; ++t) {
+            Queue& q = *queues[t % queues.size()];
+            std::lock_guard<std::mutex> ql(q.m);
+            q.tasks.push_back(Task{t, &fn});
+        }
+        ++generation;
+        wake.notify_all();
+        done.wait(lock, [this]{ return remaining.load() == 0; });
+    }
+
+private:
+    // The job travels with each task: a worker still draining one run may
+    // pick up work that the next run() has already queued.
+    struct Task {
+        size_t index;
+        const std::function<void(size_t, unsigned)>* fn;
+    };
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::atomic<size_t> remaining{0};
+    uint64_t generation = 0;
+    bool stop = false;
+
+    bool pop_or_steal(unsigned id, Task& task) {
+        {
+            Queue& own = *queues[id];
+            std::lock_guard<std::mutex> ql(own.m);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            Queue& victim = *queues[(id + k) % queues.size()];
+            std::lock_guard<std::mutex> ql(victim.m);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(unsigned id) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]{ return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+            }
+            Task task;
+            while (pop_or_steal(id, task)) {
+                (*task.fn)(task.index, id);
+                if (--remaining == 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    }
+};
+
+// Splits [0, count) into one contiguous chunk per hardware thread and runs
+// fn(chunk, begin, end) on each, in parallel. For one-shot bulk work such
+// as file parsing and BVH setup, outside the render pool.
+inline void parallel_chunks(size_t count, size_t min_chunk,
+                            const std::function<void(unsigned, size_t, size_t)>& fn) {
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    unsigned chunks = unsigned(std::min<size_t>(hw, std::max<size_t>(1, count / std::max<size_t>(1, min_chunk))));
+    if (chunks <= 1) { fn(0, 0, count); return; }
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < chunks; ++c) {
+        size_t b = count * c / chunks, e = count * (c + 1) / chunks;
+        threads.emplace_back([&fn, c, b, e]{ fn(c, b, e); });
+    }
+    for (auto& t : threads) t.join();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Image tiles handed to the render workers.
+// Pixel rows are counted top-down (row 0 is the first row written to the PPM).
+struct Tile {
+    int x0, y0; // inclusive
+    int x1, y1; // exclusive
+};
+
+enum class TileOrder { Scanline, Spiral, Hilbert };
+
+inline bool parse_tile_order(const std::string& s, TileOrder& out) {
+    if (s == "scanline") { out = TileOrder::Scanline; return true; }
+    if (s == "spiral")   { out = TileOrder::Spiral;   return true; }
+    if (s == "hilbert")  { out = TileOrder::Hilbert;  return true; }
+    return false;
+}
+
+// Hilbert index d -> (x, y) on an n x n grid (n a power of two)
+inline void hilbert_d2xy(int n, int d, int& x, int& y) {
+    x = y = 0;
+    for (int s = 1; s < n; s *= 2) {
+        int rx = 1 & (d / 2);
+        int ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            if (rx == 1) { x = s - 1 - x; y = s - 1 - y; }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+inline std::vector<Tile> make_tiles(int width, int height, int tile_size, TileOrder order) {
+    tile_size = std::max(1, tile_size);
+    const int nx = (width  + tile_size - 1) / tile_size;
+    const int ny = (height + tile_size - 1) / tile_size;
+
+    // Tile grid coordinates in visiting order
+    std::vector<std::pair<int,int>> cells;
+    cells.reserve(size_t(nx) * ny);
+
+    switch (order) {
+    case TileOrder::Scanline:
+        for (int ty = 0; ty < ny; ++ty)
+            for (int tx = 0; tx < nx; ++tx)
+                cells.emplace_back(tx, ty);
+        break;
+
+    case TileOrder::Spiral: {
+        // Walk an outward square spiral from the centre tile, skipping cells
+        // that fall outside the grid, until every tile has been visited.
+        int x = (nx - 1) / 2, y = (ny - 1) / 2;
+        int dx = 1, dy = 0, leg = 1;
+        while (cells.size() < size_t(nx) * ny) {
+            for (int rep = 0; rep < 2; ++rep) {
+                for (int k = 0; k < leg; ++k) {
+                    if (x >= 0 && x < nx && y >= 0 && y < ny) cells.emplace_back(x, y);
+                    x += dx; y += dy;
+                }
+                int t = dx; dx = -dy; dy = t; // turn 90 degrees
+            }
+            ++leg;
+        }
+        break;
+    }
+
+    case TileOrder::Hilbert: {
+        int n = 1;
+        while (n < nx || n < ny) n *= 2;
+        for (int d = 0; d < n * n; ++d) {
+            int x, y;
+            hilbert_d2xy(n, d, x, y);
+            if (x < nx && y < ny) cells.emplace_back(x, y);
+        }
+        break;
+    }
+    }
+
+    std::vector<Tile> tiles;
+    tiles.reserve(cells.size());
+    for (const auto& c : cells) {
+        Tile t;
+        t.x0 = c.first * tile_size;
+        t.y0 = c.second * tile_size;
+        t.x1 = std::min(width,  t.x0 + tile_size);
+        t.y1 = std::min(height, t.y0 + tile_size);
+        tiles.push_back(t);
+    }
+    return tiles;
+}
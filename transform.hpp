@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "vec3.hpp"
+#include "ray.hpp"
+#include "aabb.hpp"
+
+// Affine transform: p' = M p + t, stored with its inverse so that rays can
+// be taken into object space and hits brought back without inverting per ray.
+struct Transform {
+    Real m[3][4];    // row-major [M | t]
+    Real inv[3][4];  // the inverse, same layout
+
+    Transform() { set_identity(m); set_identity(inv); }
+
+    static Transform translate(const Vec3& d) {
+        Transform x;
+        x.m[0][3] = d.x;  x.m[1][3] = d.y;  x.m[2][3] = d.z;
+        x.inv[0][3] = -d.x; x.inv[1][3] = -d.y; x.inv[2][3] = -d.z;
+        return x;
+    }
+
+    static Transform scale(const Vec3& s) {
+        Transform x;
+        x.m[0][0] = s.x; x.m[1][1] = s.y; x.m[2][2] = s.z;
+        x.inv[0][0] = 1 / s.x; x.inv[1][1] = 1 / s.y; x.inv[2][2] = 1 / s.z;
+        return x;
+    }
+
+    static Transform scale(Real s) { return scale(Vec3(s, s, s)); }
+
+    // Rotation by `degrees` about the unit `axis` (right-handed)
+    static Transform rotate(const Vec3& axis, Real degrees) {
+        Vec3 a = normalize(axis);
+        Real th = degrees * Real(PI / 180);
+        Real c = std::cos(th), s = std::sin(th), k = 1 - c;
+        Real r[3][3] = {
+            {a.x * a.x * k + c,       a.x * a.y * k - a.z * s, a.x * a.z * k + a.y * s},
+            {a.y * a.x * k + a.z * s, a.y * a.y * k + c,       a.y * a.z * k - a.x * s},
+            {a.z * a.x * k - a.y * s, a.z * a.y * k + a.x * s, a.z * a.z * k + c}};
+        Transform x;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j) { x.m[i][j] = r[i][j]; x.inv[i][j] = r[j][i]; }
+        return x;
+    }
+
+    static Transform rotate_y(Real degrees) { return rotate(Vec3(0, 1, 0), degrees); }
+
+    // Applies b first, then a
+    friend Transform operator*(const Transform& a, const Transform& b) {
+        Transform x;
+        compose(a.m, b.m, x.m);
+        compose(b.inv, a.inv, x.inv);
+        return x;
+    }
+
+    Vec3 point(const Vec3& p) const { return apply(m, p) + Vec3(m[0][3], m[1][3], m[2][3]); }
+    Vec3 vector(const Vec3& v) const { return apply(m, v); }
+    // Normals go through the inverse transpose; the result is not normalised
+    Vec3 normal(const Vec3& n) const {
+        return Vec3(inv[0][0] * n.x + inv[1][0] * n.y + inv[2][0] * n.z,
+                    inv[0][1] * n.x + inv[1][1] * n.y + inv[2][1] * n.z,
+                    inv[0][2] * n.x + inv[1][2] * n.y + inv[2][2] * n.z);
+    }
+
+    Vec3 inverse_point(const Vec3& p) const { return apply(inv, p) + Vec3(inv[0][3], inv[1][3], inv[2][3]); }
+    Vec3 inverse_vector(const Vec3& v) const { return apply(inv, v); }
+
+    // World ray -> object space. The direction is not renormalised, so hit
+    // distances t mean the same thing on both sides.
+    Ray to_object(const Ray& r) const { return Ray(inverse_point(r.origin), inverse_vector(r.direction), r.time); }
+
+    // Bounds of the transformed box (all eight corners)
+    AABB box(const AABB& b) const {
+        const Real inf = std::numeric_limits<Real>::infinity();
+        Vec3 lo(inf, inf, inf), hi(-inf, -inf, -inf);
+        for (int c = 0; c < 8; ++c) {
+            Vec3 p = point(Vec3(c & 1 ? b.max().x : b.min().x,
+                                c & 2 ? b.max().y : b.min().y,
+                                c & 4 ? b.max().z : b.min().z));
+            lo = Vec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+            hi = Vec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+        }
+        return AABB(lo, hi);
+    }
+
+    // Largest absolute row sum of M: bounds how much a per-axis error grows
+    Real norm() const {
+        Real n = 0;
+        for (int i = 0; i < 3; ++i)
+            n = std::max(n, std::fabs(m[i][0]) + std::fabs(m[i][1]) + std::fabs(m[i][2]));
+        return n;
+    }
+
+    // Largest translation component, for the rounding error of point()
+    Real offset() const {
+        return std::max(std::fabs(m[0][3]), std::max(std::fabs(m[1][3]), std::fabs(m[2][3])));
+    }
+
+private:
+    static void set_identity(Real a[3][4]) {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) a[i][j] = (i == j) ? 1 : 0;
+    }
+
+    static Vec3 apply(const Real a[3][4], const Vec3& v) {
+        return Vec3(a[0][0] * v.x + a[0][1] * v.y + a[0][2] * v.z,
+                    a[1][0] * v.x + a[1][1] * v.y + a[1][2] * v.z,
+                    a[2][0] * v.x + a[2][1] * v.y + a[2][2] * v.z);
+    }
+
+    // out = a * b, as 4x4 matrices with an implicit last row 0 0 0 1
+    static void compose(const Real a[3][4], const Real b[3][4], Real out[3][4]) {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j) {
+                out[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+                if (j == 3) out[i][j] += a[i][3];
+            }
+    }
+};
@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "hittable.hpp"
+#include "bvh_build.hpp"
+#include "linear_bvh.hpp"
+#include "packet.hpp"
+#include "thread_pool.hpp"
+
+// Raw mesh buffers as loaded: SoA float positions and three vertex indices
+// per triangle.
+struct MeshData {
+    std::vector<float> px, py, pz;
+    std::vector<uint32_t> indices;
+
+    size_t vertex_count()   const { return px.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// Read-only views of a mesh's render-time buffers. They point either into a
+// TriangleMesh's own storage or straight into a mapped scene cache.
+struct MeshView {
+    const float* px = nullptr;
+    const float* py = nullptr;
+    const float* pz = nullptr;
+    const uint32_t* indices = nullptr;     // BVH leaf order
+    const LinearBVHNode* nodes = nullptr;
+    size_t num_vertices = 0, num_indices = 0, num_nodes = 0;
+};
+
+// A whole mesh as one Hittable. Triangles are not objects: they live in
+// shared SoA vertex/index buffers, and the mesh carries its own BVH built at
+// triangle granularity. The index buffer is reordered to the BVH leaf order,
+// so a leaf is just a contiguous triangle range.
+class TriangleMesh : public Hittable {
+public:
+    MeshView view;
+    MaterialId mat;
+    uint32_t light_base = NO_LIGHT; // light index of triangle 0 when the mesh is emissive
+    BVHBuildStats build_stats;
+
+    TriangleMesh(MeshData data, MaterialId m,
+                 const BVHBuildOptions& opts = BVHBuildOptions())
+        : mat(m), storage(std::move(data)) {
+        build_bvh(opts);
+        view.px = storage.px.data();
+        view.py = storage.py.data();
+        view.pz = storage.pz.data();
+        view.indices = storage.indices.data();
+        view.nodes = node_storage.data();
+        view.num_vertices = storage.px.size();
+        view.num_indices = storage.indices.size();
+        view.num_nodes = node_storage.size();
+    }
+
+    // Wraps prebuilt buffers without copying; the owner of the buffers (the
+    // Scene, for a mapped cache) must outlive the mesh
+    TriangleMesh(const MeshView& v, MaterialId m) : view(v), mat(m) {
+        if (view.num_nodes > 0) box = load_bounds(view.nodes[0]);
+    }
+
+    size_t triangle_count() const { return view.num_indices / 3; }
+
+    // Bytes held by the render-time buffers
+    size_t memory_bytes() const {
+        return 3 * view.num_vertices * sizeof(float)
+             + view.num_indices * sizeof(uint32_t)
+             + view.num_nodes * sizeof(LinearBVHNode);
+    }
+
+    Vec3 vertex(uint32_t i) const { return Vec3(view.px[i], view.py[i], view.pz[i]); }
+
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        if (view.num_nodes == 0) return false;
+        uint32_t hit_tri = 0;
+        bool any = traverse_linear(view.nodes, r, t_min, t_max,
+            [&](uint32_t first, uint32_t count, Real& t_far) {
+                bool hit_leaf = false;
+                for (uint32_t tri = first; tri < first + count; ++tri) {
+                    Real t;
+                    if (intersect(tri, r, t_min, t_far, t)) {
+                        t_far = t;
+                        hit_tri = tri;
+                        hit_leaf = true;
+                    }
+                }
+                return hit_leaf;
+            });
+        if (!any) return false;
+
+        const uint32_t* v = &view.indices[3 * size_t(hit_tri)];
+        Vec3 p0 = vertex(v[0]);
+        Vec3 outward_normal = normalize(cross(vertex(v[1]) - p0, vertex(v[2]) - p0));
+        rec.set_point(r, t_max);
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = mat;
+        rec.light = light_base == NO_LIGHT ? NO_LIGHT : light_base + hit_tri;
+        return true;
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        if (view.num_nodes == 0) return false;
+        return traverse_linear<true>(view.nodes, r, t_min, t_max,
+            [&](uint32_t first, uint32_t count, Real& t_far) {
+                Real t;
+                for (uint32_t tri = first; tri < first + count; ++tri)
+                    if (intersect(tri, r, t_min, t_far, t)) return true;
+                return false;
+            });
+    }
+
+    // Packets walk the mesh BVH together and test each leaf triangle against
+    // all their lanes at once
+    uint32_t hit_lanes(const PacketQuery& q, Real* t_max, HitRecord* rec) const override {
+        if (view.num_nodes == 0) return 0;
+        return with_packet(q, t_max, [&](auto& P) -> uint32_t {
+            constexpr int N = std::decay_t<decltype(P)>::lanes;
+            if (!P.coherent) return Hittable::hit_lanes(q, t_max, rec);
+            Real t_best[N];
+            uint32_t tri_best[N];
+            for (int k = 0; k < N; ++k) t_best[k] = (q.mask >> k & 1u) ? t_max[k] : 0.0;
+            uint32_t hits = traverse_packet<N, false>(view.nodes, P, float(q.t_min), q.simd, q.frustum,
+                [&](uint32_t first, uint32_t count, uint32_t mask) {
+                    uint32_t got = 0;
+                    for (uint32_t tri = first; tri < first + count; ++tri) {
+                        Vec3 p0, e1, e2;
+                        edges(tri, p0, e1, e2);
+                        Real t[N];
+                        uint32_t h = triangle_lanes(P, mask, p0, e1, e2, q.t_min, t_best, t);
+                        for (int k = 0; k < N; ++k) {
+                            if (!(h >> k & 1u)) continue;
+                            t_best[k] = t[k];
+                            tri_best[k] = tri;
+                            P.t_far[k] = float(t[k]);
+                        }
+                        got |= h;
+                    }
+                    return got;
+                });
+            for (int k = 0; k < N; ++k) {
+                if (!(hits >> k & 1u)) continue;
+                const uint32_t* v = &view.indices[3 * size_t(tri_best[k])];
+                Vec3 p0 = vertex(v[0]);
+                Vec3 outward_normal = normalize(cross(vertex(v[1]) - p0, vertex(v[2]) - p0));
+                const Ray& r = q.rays[k];
+                t_max[k] = t_best[k];
+                rec[k].set_point(r, t_best[k]);
+                rec[k].set_face_normal(r, outward_normal);
+                rec[k].mat = mat;
+                rec[k].light = light_base == NO_LIGHT ? NO_LIGHT : light_base + tri_best[k];
+            }
+            return hits;
+        });
+    }
+
+    uint32_t occluded_lanes(const PacketQuery& q, const Real* t_max) const override {
+        if (view.num_nodes == 0) return 0;
+        return with_packet(q, t_max, [&](auto& P) -> uint32_t {
+            constexpr int N = std::decay_t<decltype(P)>::lanes;
+            if (!P.coherent) return Hittable::occluded_lanes(q, t_max);
+            return traverse_packet<N, true>(view.nodes, P, float(q.t_min), q.simd, q.frustum,
+                [&](uint32_t first, uint32_t count, uint32_t mask) {
+                    uint32_t got = 0;
+                    for (uint32_t tri = first; tri < first + count && mask; ++tri) {
+                        Vec3 p0, e1, e2;
+                        edges(tri, p0, e1, e2);
+                        Real t[N];
+                        uint32_t h = triangle_lanes(P, mask, p0, e1, e2, q.t_min, t_max, t);
+                        got |= h;
+                        mask &= ~h;
+                    }
+                    return got;
+                });
+        });
+    }
+
+    bool bounding_box(AABB& out_box) const override {
+        out_box = box;
+        return view.num_nodes > 0;
+    }
+
+private:
+    AABB box;
+    MeshData storage;                        // empty when wrapping external buffers
+    std::vector<LinearBVHNode> node_storage;
+
+    void edges(uint32_t tri, Vec3& p0, Vec3& e1, Vec3& e2) const {
+        const uint32_t* v = &view.indices[3 * size_t(tri)];
+        p0 = vertex(v[0]);
+        e1 = vertex(v[1]) - p0;
+        e2 = vertex(v[2]) - p0;
+    }
+
+    // Moller-Trumbore
+    bool intersect(uint32_t tri, const Ray& r, Real t_min, Real t_max, Real& t_out) const {
+        const uint32_t* v = &view.indices[3 * size_t(tri)];
+        Vec3 p0 = vertex(v[0]);
+        Vec3 e1 = vertex(v[1]) - p0;
+        Vec3 e2 = vertex(v[2]) - p0;
+        Vec3 pv = cross(r.direction, e2);
+        Real det = dot(e1, pv);
+        if (std::fabs(det) < 1e-14) return false;
+        Real inv_det = 1.0 / det;
+
+        Vec3 tv = r.origin - p0;
+        Real u = dot(tv, pv) * inv_det;
+        if (u < 0.0 || u > 1.0) return false;
+        Vec3 qv = cross(tv, e1);
+        Real w = dot(r.direction, qv) * inv_det;
+        if (w < 0.0 || u + w > 1.0) return false;
+
+        Real t = dot(e2, qv) * inv_det;
+        if (t < t_min || t > t_max) return false;
+        t_out = t;
+        return true;
+    }
+
+    void build_bvh(const BVHBuildOptions& opts) {
+        auto t0 = std::chrono::steady_clock::now();
+        const std::vector<uint32_t>& indices = storage.indices;
+        const size_t n = indices.size() / 3;
+        if (n == 0) return;
+        auto vtx = [&](uint32_t i) { return Vec3(storage.px[i], storage.py[i], storage.pz[i]); };
+
+        std::vector<BVHPrimInfo> info(n);
+        parallel_chunks(n, 1 << 16, [&](unsigned, size_t b, size_t e) {
+            for (size_t tri = b; tri < e; ++tri) {
+                const uint32_t* v = &indices[3 * tri];
+                Vec3 p0 = vtx(v[0]), p1 = vtx(v[1]), p2 = vtx(v[2]);
+                AABB tb = grow(AABB(p0, p0), p1);
+                tb = grow(tb, p2);
+                info[tri] = {tb, 0.5 * (tb.min() + tb.max()), uint32_t(tri)};
+            }
+        });
+
+        auto root = BVHBuilder(info, opts).build();
+        box = root->box;
+        node_storage.clear();
+        flatten_build_tree(*root, node_storage);
+        bvh_tree_stats(*root, opts, build_stats);
+
+        // Reorder triangles to BVH leaf order
+        std::vector<uint32_t> sorted(indices.size());
+        parallel_chunks(n, 1 << 16, [&](unsigned, size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i)
+                for (int k = 0; k < 3; ++k)
+                    sorted[3 * i + k] = indices[3 * size_t(info[i].index) + k];
+        });
+        storage.indices.swap(sorted);
+
+        build_stats.build_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+    }
+};
@@ -1,71 +1,93 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <limits>
 
+#include "sampler.hpp"
+
 // ---------- constants ----------
 constexpr double PI = 3.14159265358979323846;
 
-// ---------- RNG ----------
-inline double random_double() {
-    return rand() / (RAND_MAX + 1.0);
-}
-inline double random_double(double min, double max) {
-    return min + (max - min) * random_double();
-}
+// ---------- precision ----------
+// Scalar type of the geometry core (vectors, rays, boxes, primitives, hit
+// distances). Build with -DRT_FLOAT for a single-precision renderer; the
+// default is double.
+#ifdef RT_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
 
 // ---------- Vec3 ----------
-class Vec3 {
+template <class T>
+class Vec3T {
 public:
-    double x, y, z;
+    T x, y, z;
 
-    Vec3() : x(0), y(0), z(0) {}
-    Vec3(double x, double y, double z) : x(x), y(y), z(z) {}
+    Vec3T() : x(0), y(0), z(0) {}
+    Vec3T(T x, T y, T z) : x(x), y(y), z(z) {}
+    template <class U>
+    explicit Vec3T(const Vec3T<U>& v) : x(T(v.x)), y(T(v.y)), z(T(v.z)) {}
 
-    Vec3 operator-() const { return Vec3(-x, -y, -z); }
+    Vec3T operator-() const { return Vec3T(-x, -y, -z); }
 
-    Vec3& operator+=(const Vec3& v) { x+=v.x; y+=v.y; z+=v.z; return *this; }
-    Vec3& operator*=(double t)      { x*=t;   y*=t;   z*=t;   return *this; }
-    Vec3& operator/=(double t)      { return *this *= 1.0/t; }
+    Vec3T& operator+=(const Vec3T& v) { x+=v.x; y+=v.y; z+=v.z; return *this; }
+    Vec3T& operator*=(T t)            { x*=t;   y*=t;   z*=t;   return *this; }
+    Vec3T& operator/=(T t)            { return *this *= T(1)/t; }
 
-    double length() const           { return std::sqrt(length_squared()); }
-    double length_squared() const   { return x*x + y*y + z*z; }
-};
+    T length() const           { return std::sqrt(length_squared()); }
+    T length_squared() const   { return x*x + y*y + z*z; }
 
-inline Vec3 operator+(const Vec3& a, const Vec3& b){ return Vec3(a.x+b.x, a.y+b.y, a.z+b.z); }
-inline Vec3 operator-(const Vec3& a, const Vec3& b){ return Vec3(a.x-b.x, a.y-b.y, a.z-b.z); }
-inline Vec3 operator*(const Vec3& a, const Vec3& b){ return Vec3(a.x*b.x, a.y*b.y, a.z*b.z); }
-inline Vec3 operator*(double t, const Vec3& v)     { return Vec3(t*v.x, t*v.y, t*v.z); }
-inline Vec3 operator*(const Vec3& v, double t)     { return t * v; }
-inline Vec3 operator/(Vec3 v, double t)            { return (1.0/t) * v; }
+    // Non-template friends, so a double literal scales a float vector
+    friend Vec3T operator+(const Vec3T& a, const Vec3T& b){ return Vec3T(a.x+b.x, a.y+b.y, a.z+b.z); }
+    friend Vec3T operator-(const Vec3T& a, const Vec3T& b){ return Vec3T(a.x-b.x, a.y-b.y, a.z-b.z); }
+    friend Vec3T operator*(const Vec3T& a, const Vec3T& b){ return Vec3T(a.x*b.x, a.y*b.y, a.z*b.z); }
+    friend Vec3T operator*(T t, const Vec3T& v)           { return Vec3T(t*v.x, t*v.y, t*v.z); }
+    friend Vec3T operator*(const Vec3T& v, T t)           { return t * v; }
+    friend Vec3T operator/(Vec3T v, T t)                  { return (T(1)/t) * v; }
 
-inline double dot(const Vec3& a, const Vec3& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
-inline Vec3   cross(const Vec3& a, const Vec3& b){
-    return Vec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
-}
-inline Vec3   normalize(Vec3 v){ return v / v.length(); }
+    friend T     dot(const Vec3T& a, const Vec3T& b){ return a.x*b.x + a.y*b.y + a.z*b.z; }
+    friend Vec3T cross(const Vec3T& a, const Vec3T& b){
+        return Vec3T(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+    }
+    friend Vec3T normalize(Vec3T v){ return v / v.length(); }
+};
+
+using Vec3 = Vec3T<Real>;
 
 // ---------- sampling helpers ----------
-inline Vec3 random_in_unit_sphere() {
-    while (true) {
-        Vec3 p(random_double(-1,1), random_double(-1,1), random_double(-1,1));
-        if (p.length_squared() < 1.0) return p;
-    }
+// Direct warps of uniform samples, so each one draws a fixed number of
+// dimensions and low-discrepancy points stay stratified through them
+inline Vec3 random_unit_vector(Sampler& sampler) {            // 2 dimensions
+    Sample2 s = sampler.next_2d();
+    Real z = 1 - 2 * s.u;
+    Real r = std::sqrt(std::max(Real(0), 1 - z * z));
+    Real phi = 2 * PI * s.v;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+inline Vec3 random_in_unit_sphere(Sampler& sampler) {         // 3 dimensions
+    Vec3 dir = random_unit_vector(sampler);
+    return Real(std::cbrt(sampler.next_1d())) * dir;
 }
-inline Vec3 random_unit_vector() { return normalize(random_in_unit_sphere()); }
 
-inline Vec3 random_in_unit_disk() {        // for depth-of-field lens sampling
-    while (true) {
-        Vec3 p(random_double(-1,1), random_double(-1,1), 0.0);
-        if (p.length_squared() < 1.0) return p;
-    }
+// Concentric square-to-disk map (Shirley & Chiu), 2 dimensions
+inline Vec3 random_in_unit_disk(Sampler& sampler) {        // for depth-of-field lens sampling
+    Sample2 s = sampler.next_2d();
+    Real a = 2 * s.u - 1, b = 2 * s.v - 1;
+    if (a == 0 && b == 0) return Vec3(0, 0, 0);
+    Real r, phi;
+    if (std::fabs(a) > std::fabs(b)) { r = a; phi = Real(PI / 4) * (b / a); }
+    else                             { r = b; phi = Real(PI / 2) - Real(PI / 4) * (a / b); }
+    return Vec3(r * std::cos(phi), r * std::sin(phi), 0.0);
 }
 
 inline bool near_zero(const Vec3& v){
-    const double s = 1e-8;
+    const Real s = Real(1e-8);
     return (std::fabs(v.x) < s) && (std::fabs(v.y) < s) && (std::fabs(v.z) < s);
 }
 
@@ -73,11 +95,17 @@ inline bool near_zero(const Vec3& v){
 inline Vec3 reflect(const Vec3& v, const Vec3& n){
     return v - 2.0 * dot(v, n) * n;
 }
-inline Vec3 refract(const Vec3& uv, const Vec3& n, double etai_over_etat){
-    double cos_theta = fmin(dot(-uv, n), 1.0);
+inline Vec3 refract(const Vec3& uv, const Vec3& n, Real etai_over_etat){
+    Real cos_theta = std::fmin(dot(-uv, n), Real(1));
     Vec3 r_out_perp  = etai_over_etat * (uv + cos_theta * n);
-    Vec3 r_out_par   = -std::sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    Vec3 r_out_par   = -std::sqrt(std::fabs(Real(1) - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_par;
 }
 
+// ---------- colour ----------
+// Rec. 709 luminance of linear RGB
+inline double luminance(const Vec3& c){
+    return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
+}
+
 #endif
@@ -0,0 +1,428 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "camera.hpp"
+#include "denoise.hpp"
+#include "direct_light.hpp"
+#include "film.hpp"
+#include "stats.hpp"
+#include "sampler.hpp"
+#include "scene.hpp"
+#include "tiles.hpp"
+
+enum class IntegratorKind { Recursive, Wavefront };
+
+inline bool parse_integrator(const std::string& s, IntegratorKind& out) {
+    if (s == "recursive") { out = IntegratorKind::Recursive; return true; }
+    if (s == "wavefront") { out = IntegratorKind::Wavefront; return true; }
+    return false;
+}
+
+struct WavefrontParams {
+    int width = 0, height = 0;
+    int spp = 1;                      // samples per pixel of render_tile(tile, sums)
+    int max_depth = 1;
+    int light_samples = 1;
+    int brdf_samples = 1;
+    uint64_t seed = 0;
+    SamplerType sampler = SamplerType::Independent;
+    int packet_size = 1;              // 4/8/16 => trace queues as ray packets, 1 => ray by ray
+    SimdLevel simd = SimdLevel::Scalar;
+};
+
+// Three parallel coordinate arrays
+struct Vec3SoA {
+    std::vector<Real> x, y, z;
+
+    void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+    void clear() { x.clear(); y.clear(); z.clear(); }
+    Vec3 get(size_t i) const { return Vec3(x[i], y[i], z[i]); }
+    void set(size_t i, const Vec3& v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+    void push(const Vec3& v) { x.push_back(v.x); y.push_back(v.y); z.push_back(v.z); }
+};
+
+// Queue-based path tracer. A tile's camera paths (every pixel sample) are
+// kept in structure-of-arrays buffers and advanced one bounce at a time by
+// stages that each run as a tight loop over a queue of path ids:
+//
+//   generate -> extend (closest hit) -> shade (bucketed by material type)
+//            -> shadow (any-hit) + probe (closest hit for BRDF-sampled MIS)
+//
+// and then back to extend with the paths that survived. Estimator-wise it is
+// the recursive integrator unrolled: same Russian roulette, same NEE/MIS, and
+// each path's sampler stream is restarted at its bounce's dimensions (the
+// same PathDims layout) so results do not depend on batching. One instance
+// per worker thread.
+//
+// With a packet size above 1 the coherent queues, camera rays and the
+// shadow rays cast from their hits, go to the scene as packets of
+// consecutive entries. generate() emits camera rays pixel by pixel, so those
+// packets are tight and also get frustum culling. Later bounces and BRDF
+// probes scatter in all directions and are traced ray by ray.
+class WavefrontIntegrator {
+public:
+    WavefrontIntegrator(const Scene& scene, const Camera& cam, const WavefrontParams& params)
+        : scene(scene), cam(cam), params(params),
+          dims{uint32_t(params.light_samples), uint32_t(params.brdf_samples)} {}
+
+    uint64_t rays_traced = 0;   // extension, shadow and probe rays cast so far
+    RT_STAT(std::vector<double> pixel_work;) // traversal work per tile pixel of the last tile, summed over samples
+
+    // Writes the radiance sum over all samples of each tile pixel into `sums`,
+    // row-major over the tile (rows top-down, like Tile)
+    void render_tile(const Tile& tile, std::vector<Vec3>& sums) {
+        const size_t pixels = size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        std::vector<uint32_t> first(pixels, 0), count(pixels, uint32_t(params.spp));
+        std::vector<double> sum_sq(pixels, 0.0);
+        std::vector<Features> features(pixels);
+        sums.assign(pixels, Vec3(0,0,0));
+        render_tile(tile, first, count, sums, sum_sq, features, nullptr);
+    }
+
+    // Progressive form: adds samples [first[p], first[p] + count[p]) of each
+    // tile pixel p to sums[p], their squared luminance to sum_sq[p] and their
+    // first-hit guides to features[p], and each sample to `film` if given,
+    // one sample at a time in sample order, so splitting a render into
+    // passes does not change the result. Pixels with a count of 0 are
+    // skipped.
+    void render_tile(const Tile& tile, const std::vector<uint32_t>& first, const std::vector<uint32_t>& count,
+                     std::vector<Vec3>& sums, std::vector<double>& sum_sq, std::vector<Features>& features,
+                     FilmTile* film) {
+        generate(tile, first, count);
+        bool primary = true;
+        while (!active.empty()) {
+            const bool packets = primary && params.packet_size > 1;
+            extend(packets);
+            sort_by_material();
+            shade();
+            resolve_shadows(packets);
+            resolve_probes();
+            rays_traced += active.size() + shadow.path.size() + probe.path.size();
+            RT_STAT(RenderStats& st = thread_stats();
+                    if (!primary) st.indirect_rays += active.size();
+                    st.shadow_rays += shadow.path.size();
+                    st.probe_rays += probe.path.size();)
+            active.swap(next_active);
+            primary = false;
+        }
+
+        // Path ids run pixel by pixel, samples in order within a pixel
+        const int tw = tile.x1 - tile.x0;
+        for (uint32_t id = 0; id < tile_pixel.size(); ++id) {
+            const Vec3 l = L.get(id);
+            sums[tile_pixel[id]] += l;
+            sum_sq[tile_pixel[id]] += luminance(l) * luminance(l);
+            features[tile_pixel[id]].add(first_hit[id]);
+            if (film)
+                film->add(tile.x0 + int(tile_pixel[id] % tw), tile.y0 + int(tile_pixel[id] / tw),
+                          film_offset[id].u, film_offset[id].v, l);
+        }
+        RT_STAT(pixel_work.assign(count.size(), 0.0);
+                for (uint32_t id = 0; id < tile_pixel.size(); ++id) pixel_work[tile_pixel[id]] += double(work[id]);)
+    }
+
+private:
+    static constexpr int MAX_PACKET = 16;
+
+    const Scene& scene;
+    const Camera& cam;
+    WavefrontParams params;
+    PathDims dims;                    // where each bounce's sampler dimensions start
+
+    // Path state, indexed by path id: the current call's samples, pixel by
+    // pixel
+    Vec3SoA ray_o, ray_d;
+    std::vector<Real> ray_time;
+    Vec3SoA beta;                     // throughput
+    Vec3SoA L;                        // radiance gathered so far
+    std::vector<uint32_t> pixel, sample, depth;
+    std::vector<uint32_t> tile_pixel;  // index of the path's pixel within the tile
+    std::vector<Features> first_hit;   // denoiser guides from the camera ray's hit
+    std::vector<Sample2> film_offset;  // the sample's offset from its pixel's centre, image axes
+    RT_STAT(std::vector<uint64_t> work;)  // traversal work of each path's rays
+
+    // Closest hit of each path's current ray (extend stage)
+    std::vector<Real> hit_t, hit_err;
+    Vec3SoA hit_p, hit_n;
+    std::vector<uint8_t> hit_front;
+    std::vector<MaterialId> hit_mat;
+    std::vector<uint32_t> hit_light;
+
+    // Path-id queues
+    std::vector<uint32_t> active, next_active, hit_queue, shade_queue;
+
+    // Shadow rays: add `contrib` to L[path] if unoccluded up to t_max
+    struct {
+        Vec3SoA o, d, contrib;
+        std::vector<Real> time, t_max;
+        std::vector<uint32_t> path;
+        Ray ray(size_t k) const { return Ray(o.get(k), d.get(k), time[k]); }
+        void clear() { o.clear(); d.clear(); contrib.clear(); time.clear(); t_max.clear(); path.clear(); }
+    } shadow;
+
+    // BRDF probes: add their contribution to L[path] if they land on a light
+    struct {
+        Vec3SoA o, d, n, f;
+        std::vector<Real> time;
+        std::vector<double> cos_i;
+        std::vector<uint32_t> path;
+        Ray ray(size_t k) const { return Ray(o.get(k), d.get(k), time[k]); }
+        void clear() { o.clear(); d.clear(); n.clear(); f.clear(); time.clear(); cos_i.clear(); path.clear(); }
+    } probe;
+
+    void generate(const Tile& tile, const std::vector<uint32_t>& first, const std::vector<uint32_t>& count) {
+        const int tw = tile.x1 - tile.x0;
+        size_t n = 0;
+        for (uint32_t c : count) n += c;
+
+        ray_o.resize(n); ray_d.resize(n); ray_time.resize(n);
+        beta.resize(n); L.resize(n);
+        pixel.resize(n); sample.resize(n); depth.resize(n); tile_pixel.resize(n);
+        first_hit.assign(n, Features());
+        film_offset.resize(n);
+        hit_t.resize(n); hit_err.resize(n); hit_p.resize(n); hit_n.resize(n);
+        hit_front.resize(n); hit_mat.resize(n); hit_light.resize(n);
+        active.resize(n);
+        RT_STAT(work.assign(n, 0); thread_stats().camera_rays += n;)
+
+        // Image row y (top-down) corresponds to camera row j = height-1-y
+        Sampler sampler(params.seed, params.sampler);
+        uint32_t id = 0;
+        for (uint32_t local = 0; local < count.size(); ++local) {
+            int i = tile.x0 + int(local % tw);
+            int j = params.height - 1 - (tile.y0 + int(local / tw));
+            for (uint32_t k = 0; k < count[local]; ++k, ++id) {
+                tile_pixel[id] = local;
+                pixel[id]  = uint32_t(j) * params.width + i;
+                sample[id] = first[local] + k;
+                sampler.start(pixel[id], sample[id]);
+                Sample2 film = sampler.next_2d();
+                film_offset[id] = {film.u - 0.5, 0.5 - film.v};
+                double u = (i + film.u) / (params.width  - 1);
+                double v = (j + film.v) / (params.height - 1);
+                Ray r = cam.get_ray(u, v, sampler);
+                ray_o.set(id, r.origin);
+                ray_d.set(id, r.direction);
+                ray_time[id] = r.time;
+                depth[id] = 0;
+                beta.set(id, Vec3(1,1,1));
+                L.set(id, Vec3(0,0,0));
+                active[id] = id;
+            }
+        }
+    }
+
+    Ray path_ray(uint32_t id) const { return Ray(ray_o.get(id), ray_d.get(id), ray_time[id]); }
+
+    void store_hit(uint32_t id, const HitRecord& rec) {
+        hit_t[id] = rec.t;
+        hit_err[id] = rec.error;
+        hit_p.set(id, rec.point);
+        hit_n.set(id, rec.normal);
+        hit_front[id] = rec.front_face;
+        hit_mat[id] = rec.mat;
+        hit_light[id] = rec.light;
+        hit_queue.push_back(id);
+    }
+
+    PacketQuery packet_query(const Ray* rays, size_t count, bool frustum) const {
+        return PacketQuery{rays, uint32_t((1ull << count) - 1), params.packet_size, 0, params.simd, frustum};
+    }
+
+    // Closest hit for every active path; paths that escape are done
+    void extend(bool packets) {
+        hit_queue.clear();
+        const Real inf = std::numeric_limits<Real>::infinity();
+        if (packets) {
+            Ray rays[MAX_PACKET];
+            Real t_max[MAX_PACKET];
+            HitRecord rec[MAX_PACKET];
+            const size_t n = size_t(params.packet_size);
+            for (size_t base = 0; base < active.size(); base += n) {
+                const size_t count = std::min(n, active.size() - base);
+                for (size_t k = 0; k < count; ++k) {
+                    rays[k] = path_ray(active[base + k]);
+                    t_max[k] = inf;
+                }
+                RT_STAT(uint64_t w0 = traversal_work();)
+                uint32_t hits = scene.hit_lanes(packet_query(rays, count, true), t_max, rec);
+                RT_STAT(charge_packet(&active[base], count, traversal_work() - w0);)
+                for (size_t k = 0; k < count; ++k) {
+                    if (hits >> k & 1u) store_hit(active[base + k], rec[k]);
+                    RT_STAT(else thread_stats().end_path(int(depth[active[base + k]]) + 1);)
+                }
+            }
+            return;
+        }
+        for (uint32_t id : active) {
+            HitRecord rec;
+            RT_STAT(uint64_t w0 = traversal_work();)
+            bool hit = scene.hit(path_ray(id), 0, inf, rec);
+            RT_STAT(work[id] += traversal_work() - w0;)
+            if (hit) store_hit(id, rec);
+            RT_STAT(else thread_stats().end_path(int(depth[id]) + 1);)
+        }
+    }
+
+#ifdef RT_STATS
+    // Splits the work of one packet evenly over its lanes' paths
+    void charge_packet(const uint32_t* ids, size_t count, uint64_t w) {
+        for (size_t k = 0; k < count; ++k) work[ids[k]] += w / count;
+    }
+#endif
+
+    // Counting sort of the hit queue by material type, so the shade loop
+    // runs each material's code over one contiguous run of paths
+    void sort_by_material() {
+        constexpr size_t TYPES = size_t(MaterialType::DiffuseLight) + 1;
+        size_t start[TYPES + 1] = {};
+        for (uint32_t id : hit_queue) ++start[size_t(scene.material(hit_mat[id]).type) + 1];
+        for (size_t t = 0; t < TYPES; ++t) start[t + 1] += start[t];
+        shade_queue.resize(hit_queue.size());
+        for (uint32_t id : hit_queue) shade_queue[start[size_t(scene.material(hit_mat[id]).type)]++] = id;
+    }
+
+    HitRecord hit_record(uint32_t id) const {
+        HitRecord rec;
+        rec.t = hit_t[id];
+        rec.error = hit_err[id];
+        rec.point = hit_p.get(id);
+        rec.normal = hit_n.get(id);
+        rec.front_face = hit_front[id];
+        rec.mat = hit_mat[id];
+        rec.light = hit_light[id];
+        return rec;
+    }
+
+    // Emission, scattering, Russian roulette and NEE for every path that hit
+    // something. Queues next bounce's rays, shadow rays and BRDF probes.
+    void shade() {
+        next_active.clear();
+        shadow.clear();
+        probe.clear();
+        Sampler sampler(params.seed, params.sampler);
+        const bool nee = !scene.lights.empty();
+
+        for (uint32_t id : shade_queue) {
+            HitRecord rec = hit_record(id);
+            const Material& mat = scene.material(rec.mat);
+            Vec3 b = beta.get(id);
+            const int bounce = int(depth[id]);
+            sampler.start(pixel[id], sample[id], dims.scatter(bounce));
+
+            L.set(id, L.get(id) + b * mat.emitted(rec));
+            if (bounce == 0) {
+                first_hit[id].albedo = mat.albedo();
+                first_hit[id].normal = rec.normal;
+                first_hit[id].depth = rec.t * ray_d.get(id).length();
+            }
+
+            Ray scattered;
+            Vec3 attenuation;
+            if (!mat.scatter(path_ray(id), rec, attenuation, scattered, sampler)) {
+                RT_STAT(thread_stats().end_path(int(depth[id]) + 1);)
+                continue;
+            }
+
+            if (int(depth[id]) > 4) {
+                double p = std::max(attenuation.x, std::max(attenuation.y, attenuation.z));
+                p = std::min(1.0, std::max(0.05, p));
+                sampler.seek(dims.roulette(bounce));
+                if (sampler.next_1d() > p) {
+                    RT_STAT(++thread_stats().rr_terminations; thread_stats().end_path(int(depth[id]) + 1);)
+                    continue;
+                }
+                attenuation /= p;
+            }
+
+            if (nee && mat.is_diffuse()) {
+                const Vec3 f = mat.color / PI;
+                const Vec3 b_light = b / double(params.light_samples);
+                for (int s = 0; s < params.light_samples; ++s) {
+                    ShadowQuery q;
+                    sampler.seek(dims.light(bounce, s));
+                    if (!sample_light_query(scene, rec, f, ray_time[id], sampler, q)) continue;
+                    shadow.o.push(q.ray.origin);
+                    shadow.d.push(q.ray.direction);
+                    shadow.time.push_back(q.ray.time);
+                    shadow.t_max.push_back(q.t_max);
+                    shadow.contrib.push(b_light * q.contribution);
+                    shadow.path.push_back(id);
+                }
+                const Vec3 f_brdf = b * f / double(std::max(1, params.brdf_samples));
+                for (int s = 0; s < params.brdf_samples; ++s) {
+                    BrdfProbe q;
+                    sampler.seek(dims.brdf(bounce, s));
+                    if (!sample_brdf_probe(rec, ray_time[id], sampler, q)) continue;
+                    probe.o.push(q.ray.origin);
+                    probe.d.push(q.ray.direction);
+                    probe.time.push_back(q.ray.time);
+                    probe.n.push(rec.normal);
+                    probe.f.push(f_brdf);
+                    probe.cos_i.push_back(q.cos_i);
+                    probe.path.push_back(id);
+                }
+            }
+
+            if (int(++depth[id]) >= params.max_depth) {
+                RT_STAT(thread_stats().end_path(int(depth[id]));)
+                continue;
+            }
+            beta.set(id, b * attenuation);
+            ray_o.set(id, scattered.origin);
+            ray_d.set(id, scattered.direction);
+            ray_time[id] = scattered.time;
+            next_active.push_back(id);
+        }
+    }
+
+    void resolve_shadows(bool packets) {
+        if (packets) {
+            Ray rays[MAX_PACKET];
+            const size_t n = size_t(params.packet_size);
+            for (size_t base = 0; base < shadow.path.size(); base += n) {
+                const size_t count = std::min(n, shadow.path.size() - base);
+                for (size_t k = 0; k < count; ++k) rays[k] = shadow.ray(base + k);
+                RT_STAT(uint64_t w0 = traversal_work();)
+                uint32_t blocked = scene.occluded_lanes(packet_query(rays, count, false), &shadow.t_max[base]);
+                RT_STAT(charge_packet(&shadow.path[base], count, traversal_work() - w0);)
+                for (size_t k = 0; k < count; ++k)
+                    if (!(blocked >> k & 1u)) add_shadow(base + k);
+            }
+            return;
+        }
+        for (size_t k = 0; k < shadow.path.size(); ++k) {
+            RT_STAT(uint64_t w0 = traversal_work();)
+            bool blocked = scene.occluded(shadow.ray(k), 0, shadow.t_max[k]);
+            RT_STAT(work[shadow.path[k]] += traversal_work() - w0;)
+            if (!blocked) add_shadow(k);
+        }
+    }
+
+    void add_shadow(size_t k) {
+        uint32_t id = shadow.path[k];
+        L.set(id, L.get(id) + shadow.contrib.get(k));
+    }
+
+    void resolve_probes() {
+        const Real inf = std::numeric_limits<Real>::infinity();
+        for (size_t k = 0; k < probe.path.size(); ++k) {
+            HitRecord lrec;
+            RT_STAT(uint64_t w0 = traversal_work();)
+            bool hit = scene.hit(probe.ray(k), 0, inf, lrec);
+            RT_STAT(work[probe.path[k]] += traversal_work() - w0;)
+            if (hit) add_probe(k, lrec);
+        }
+    }
+
+    void add_probe(size_t k, const HitRecord& lrec) {
+        BrdfProbe q;
+        q.ray = probe.ray(k);
+        q.cos_i = probe.cos_i[k];
+        uint32_t id = probe.path[k];
+        L.set(id, L.get(id) + brdf_probe_contribution(scene, probe.n.get(k), probe.f.get(k), q, lrec));
+    }
+};
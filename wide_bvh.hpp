@@ -0,0 +1,376 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "hittable.hpp"
+#include "bvh.hpp"
+#include "linear_bvh.hpp"
+#include "simd.hpp"
+#include "stats.hpp"
+
+// N-wide BVH node: the bounds of all N children in SoA float lanes, so one
+// node visit tests every child box at once. Empty lanes carry an inverted
+// (+inf, -inf) box that never hits.
+template <int N>
+struct alignas(32) WideBVHNode {
+    float    bmin[3][N];
+    float    bmax[3][N];
+    uint32_t child[N]; // interior: node index; leaf: first primitive
+    uint16_t count[N]; // 0 => interior child (or empty lane, see child == EMPTY)
+
+    static constexpr uint32_t EMPTY = 0xffffffffu;
+};
+
+// Per-lane child bounds at shutter open [0] and close [1], for wide BVHs
+// over moving primitives (see LinearBVHMotion)
+template <int N>
+struct WideBVHMotion {
+    float bmin[2][3][N];
+    float bmax[2][3][N];
+};
+
+// Ray in the float form the lane kernels want. Near/far plane selection is
+// done once per ray from the direction signs, so the kernels need no min/max
+// per slab.
+struct WideRay {
+    float o[3];
+    float inv[3];
+    int   neg[3];
+
+    explicit WideRay(const Ray& r) {
+        const Real d[3] = {r.direction.x, r.direction.y, r.direction.z};
+        o[0] = float(r.origin.x); o[1] = float(r.origin.y); o[2] = float(r.origin.z);
+        for (int a = 0; a < 3; ++a) {
+            inv[a] = float(1.0 / d[a]);
+            neg[a] = inv[a] < 0.0f;
+        }
+    }
+};
+
+// Widens t_far by a few ulps so float rounding never culls a grazing hit
+static constexpr float WIDE_T_FAR_SCALE = 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon();
+
+// ---------- lane kernels ----------
+// Each returns a bit mask of the lanes whose box overlaps [t_min, t_max] and
+// writes the entry distance of every lane to t_near.
+
+template <int N>
+struct ScalarLanes {
+    static int test(const WideBVHNode<N>& n, const WideRay& r, float t_min, float t_max, float* t_near) {
+        int mask = 0;
+        for (int k = 0; k < N; ++k) {
+            float tn = t_min, tf = t_max;
+            for (int a = 0; a < 3; ++a) {
+                float lo = r.neg[a] ? n.bmax[a][k] : n.bmin[a][k];
+                float hi = r.neg[a] ? n.bmin[a][k] : n.bmax[a][k];
+                float t0 = (lo - r.o[a]) * r.inv[a];
+                float t1 = (hi - r.o[a]) * r.inv[a] * WIDE_T_FAR_SCALE;
+                tn = t0 > tn ? t0 : tn;
+                tf = t1 < tf ? t1 : tf;
+            }
+            t_near[k] = tn;
+            if (tn <= tf) mask |= 1 << k;
+        }
+        return mask;
+    }
+};
+
+#if RT_X86_SIMD
+RT_TARGET_SSE inline int sse_lanes4(const float* const lo[3], const float* const hi[3],
+                                    const WideRay& r, float t_min, float t_max, float* t_near) {
+    __m128 tn = _mm_set1_ps(t_min);
+    __m128 tf = _mm_set1_ps(t_max);
+    const __m128 scale = _mm_set1_ps(WIDE_T_FAR_SCALE);
+    for (int a = 0; a < 3; ++a) {
+        __m128 o   = _mm_set1_ps(r.o[a]);
+        __m128 inv = _mm_set1_ps(r.inv[a]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lo[a]), o), inv);
+        __m128 t1 = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(hi[a]), o), inv), scale);
+        tn = _mm_max_ps(t0, tn);
+        tf = _mm_min_ps(t1, tf);
+    }
+    _mm_storeu_ps(t_near, tn);
+    return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+}
+
+template <int N>
+struct SSELanes {
+    RT_TARGET_SSE static int test(const WideBVHNode<N>& n, const WideRay& r,
+                                  float t_min, float t_max, float* t_near) {
+        int mask = 0;
+        for (int base = 0; base < N; base += 4) {
+            const float* lo[3];
+            const float* hi[3];
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = (r.neg[a] ? n.bmax[a] : n.bmin[a]) + base;
+                hi[a] = (r.neg[a] ? n.bmin[a] : n.bmax[a]) + base;
+            }
+            mask |= sse_lanes4(lo, hi, r, t_min, t_max, t_near + base) << base;
+        }
+        return mask;
+    }
+};
+
+struct AVX2Lanes8 {
+    RT_TARGET_AVX2 static int test(const WideBVHNode<8>& n, const WideRay& r,
+                                   float t_min, float t_max, float* t_near) {
+        __m256 tn = _mm256_set1_ps(t_min);
+        __m256 tf = _mm256_set1_ps(t_max);
+        const __m256 scale = _mm256_set1_ps(WIDE_T_FAR_SCALE);
+        for (int a = 0; a < 3; ++a) {
+            const float* lo = r.neg[a] ? n.bmax[a] : n.bmin[a];
+            const float* hi = r.neg[a] ? n.bmin[a] : n.bmax[a];
+            __m256 o   = _mm256_set1_ps(r.o[a]);
+            __m256 inv = _mm256_set1_ps(r.inv[a]);
+            __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(lo), o), inv);
+            __m256 t1 = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(hi), o), inv), scale);
+            tn = _mm256_max_ps(t0, tn);
+            tf = _mm256_min_ps(t1, tf);
+        }
+        _mm256_storeu_ps(t_near, tn);
+        return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+    }
+};
+#endif
+
+// 4- or 8-wide BVH collapsed from the flattened binary BVH. At each wide
+// node the largest-area interior child is opened until N children are
+// gathered.
+template <int N>
+class WideBVH : public Hittable {
+    static_assert(N == 4 || N == 8, "WideBVH supports 4 and 8 lanes");
+public:
+    using Node = WideBVHNode<N>;
+
+    std::vector<Node> nodes;
+    std::vector<WideBVHMotion<N>> motion; // per node; empty unless the binary BVH has motion bounds
+    std::vector<uint32_t> source;         // binary node behind each lane (N per node), for refit
+    std::vector<const Hittable*> prims;
+    SimdLevel simd;
+
+    explicit WideBVH(const LinearBVH& bin, SimdLevel level = detect_simd())
+        : prims(bin.prims), simd(level) {
+        if (bin.nodes.empty()) return; // empty scene
+        bin.bounding_box(root_box);
+        if (bin.nodes[0].count > 0) {
+            // A single leaf still needs a node above it
+            add_node();
+            set_leaf(0, 0, bin, 0);
+        } else {
+            collapse(bin, 0);
+        }
+    }
+
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        if (nodes.empty()) return false;
+#if RT_X86_SIMD
+        if constexpr (N == 8) {
+            if (simd == SimdLevel::AVX2) return traverse<AVX2Lanes8>(r, t_min, t_max, rec);
+        }
+        if (simd != SimdLevel::Scalar) return traverse<SSELanes<N>>(r, t_min, t_max, rec);
+#endif
+        return traverse<ScalarLanes<N>>(r, t_min, t_max, rec);
+    }
+
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        if (nodes.empty()) return false;
+#if RT_X86_SIMD
+        if constexpr (N == 8) {
+            if (simd == SimdLevel::AVX2) return traverse_any<AVX2Lanes8>(r, t_min, t_max);
+        }
+        if (simd != SimdLevel::Scalar) return traverse_any<SSELanes<N>>(r, t_min, t_max);
+#endif
+        return traverse_any<ScalarLanes<N>>(r, t_min, t_max);
+    }
+
+    bool bounding_box(AABB& out_box) const override {
+        out_box = root_box;
+        return !nodes.empty();
+    }
+
+    // Re-copies the lane bounds from `bin` after LinearBVH::refit(); the
+    // topology must be the one this BVH was collapsed from
+    void refit(const LinearBVH& bin) {
+        bin.bounding_box(root_box);
+        for (uint32_t i = 0; i < uint32_t(nodes.size()); ++i)
+            for (int k = 0; k < N; ++k)
+                if (nodes[i].child[k] != Node::EMPTY) copy_bounds(i, k, bin, source[size_t(i) * N + k]);
+    }
+
+private:
+    AABB root_box;
+
+    struct StackEntry {
+        uint32_t ref;
+        uint32_t count; // > 0 => leaf primitive range
+        float    t;     // entry distance, for culling once a closer hit is found
+    };
+
+    template <class Lanes>
+    bool traverse(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const {
+        const WideRay wr(r);
+        StackEntry stack[64 * (N - 1) + 1];
+        int sp = 0;
+        stack[sp++] = {0, 0, -std::numeric_limits<float>::infinity()};
+        bool hit_anything = false;
+        const float a = shutter_fraction(r.time);
+        Node moved;
+        RT_STAT(RenderStats& st = thread_stats();)
+
+        while (sp > 0) {
+            const StackEntry e = stack[--sp];
+            if (e.t > float(t_max)) continue;
+
+            if (e.count > 0) {
+                RT_STAT(st.prim_tests += e.count;)
+                for (uint32_t i = 0; i < e.count; ++i) {
+                    if (prims[e.ref + i]->hit(r, t_min, t_max, rec)) {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                }
+                continue;
+            }
+
+            const Node& n = motion.empty() ? nodes[e.ref] : at_time(e.ref, a, moved);
+            RT_STAT(++st.nodes_visited;)
+            alignas(32) float t_near[N];
+            int mask = Lanes::test(n, wr, float(t_min), float(t_max), t_near);
+
+            // Push hit children farthest first, so the nearest is popped next
+            StackEntry hits[N];
+            int h = 0;
+            for (int k = 0; k < N; ++k) {
+                if (!(mask & (1 << k)) || n.child[k] == Node::EMPTY) continue;
+                StackEntry c{n.child[k], n.count[k], t_near[k]};
+                int j = h++;
+                while (j > 0 && hits[j - 1].t < c.t) { hits[j] = hits[j - 1]; --j; }
+                hits[j] = c;
+            }
+            for (int k = 0; k < h; ++k) stack[sp++] = hits[k];
+        }
+        return hit_anything;
+    }
+
+    // Any-hit variant: no distance sort, returns on the first blocker
+    template <class Lanes>
+    bool traverse_any(const Ray& r, Real t_min, Real t_max) const {
+        const WideRay wr(r);
+        uint32_t stack[64 * (N - 1) + 1];
+        int sp = 0;
+        stack[sp++] = 0;
+        RT_STAT(RenderStats& st = thread_stats();)
+        const float a = shutter_fraction(r.time);
+        Node moved;
+
+        while (sp > 0) {
+            const uint32_t ref = stack[--sp];
+            const Node& n = motion.empty() ? nodes[ref] : at_time(ref, a, moved);
+            RT_STAT(++st.nodes_visited;)
+            alignas(32) float t_near[N];
+            int mask = Lanes::test(n, wr, float(t_min), float(t_max), t_near);
+            for (int k = 0; k < N; ++k) {
+                if (!(mask & (1 << k)) || n.child[k] == Node::EMPTY) continue;
+                if (n.count[k] == 0) { stack[sp++] = n.child[k]; continue; }
+                RT_STAT(st.prim_tests += n.count[k];)
+                for (uint32_t i = 0; i < n.count[k]; ++i)
+                    if (prims[n.child[k] + i]->occluded(r, t_min, t_max)) return true;
+            }
+        }
+        return false;
+    }
+
+    static void clear_lanes(Node& n) {
+        const float inf = std::numeric_limits<float>::infinity();
+        for (int k = 0; k < N; ++k) {
+            for (int a = 0; a < 3; ++a) { n.bmin[a][k] = inf; n.bmax[a][k] = -inf; }
+            n.child[k] = Node::EMPTY;
+            n.count[k] = 0;
+        }
+    }
+
+    // Copy of node `ref` with its child boxes interpolated to shutter fraction a
+    const Node& at_time(uint32_t ref, float a, Node& out) const {
+        const Node& n = nodes[ref];
+        const WideBVHMotion<N>& m = motion[ref];
+        for (int ax = 0; ax < 3; ++ax)
+            for (int k = 0; k < N; ++k) {
+                out.bmin[ax][k] = lerp_bound(m.bmin[0][ax][k], m.bmin[1][ax][k], a);
+                out.bmax[ax][k] = lerp_bound(m.bmax[0][ax][k], m.bmax[1][ax][k], a);
+            }
+        for (int k = 0; k < N; ++k) { out.child[k] = n.child[k]; out.count[k] = n.count[k]; }
+        return out;
+    }
+
+    uint32_t add_node() {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        clear_lanes(nodes[index]);
+        source.resize(nodes.size() * N, Node::EMPTY);
+        return index;
+    }
+
+    void copy_bounds(uint32_t node, int k, const LinearBVH& bin, uint32_t from) {
+        const LinearBVHNode& b = bin.nodes[from];
+        source[size_t(node) * N + k] = from;
+        for (int a = 0; a < 3; ++a) {
+            nodes[node].bmin[a][k] = b.bmin[a];
+            nodes[node].bmax[a][k] = b.bmax[a];
+        }
+        if (bin.motion.empty()) return;
+        if (motion.size() < nodes.size()) {
+            // Empty lanes get an inverted box at both shutter ends; finite,
+            // so interpolating it cannot produce NaNs
+            const float big = std::numeric_limits<float>::max();
+            WideBVHMotion<N> none;
+            for (int t = 0; t < 2; ++t)
+                for (int a = 0; a < 3; ++a)
+                    for (int l = 0; l < N; ++l) { none.bmin[t][a][l] = big; none.bmax[t][a][l] = -big; }
+            motion.resize(nodes.size(), none);
+        }
+        const LinearBVHMotion& m = bin.motion[from];
+        for (int t = 0; t < 2; ++t)
+            for (int a = 0; a < 3; ++a) {
+                motion[node].bmin[t][a][k] = m.bmin[t][a];
+                motion[node].bmax[t][a][k] = m.bmax[t][a];
+            }
+    }
+
+    void set_leaf(uint32_t node, int k, const LinearBVH& bin, uint32_t leaf) {
+        copy_bounds(node, k, bin, leaf);
+        nodes[node].child[k] = bin.nodes[leaf].offset;
+        nodes[node].count[k] = bin.nodes[leaf].count;
+    }
+
+    uint32_t collapse(const LinearBVH& tree, uint32_t n) {
+        const std::vector<LinearBVHNode>& bin = tree.nodes;
+        uint32_t index = add_node();
+
+        std::vector<uint32_t> kids = {n + 1, bin[n].offset};
+        while (int(kids.size()) < N) {
+            int best = -1;
+            double best_area = -1.0;
+            for (int k = 0; k < int(kids.size()); ++k) {
+                if (bin[kids[k]].count > 0) continue;
+                double a = surface_area(load_bounds(bin[kids[k]]));
+                if (a > best_area) { best_area = a; best = k; }
+            }
+            if (best < 0) break;
+            uint32_t open = kids[best];
+            kids[best] = open + 1;
+            kids.push_back(bin[open].offset);
+        }
+
+        for (int k = 0; k < int(kids.size()); ++k) {
+            if (bin[kids[k]].count > 0) {
+                set_leaf(index, k, tree, kids[k]);
+            } else {
+                uint32_t child = collapse(tree, kids[k]);
+                copy_bounds(index, k, tree, kids[k]);
+                nodes[index].child[k] = child;
+                nodes[index].count[k] = 0;
+            }
+        }
+        return index;
+    }
+};
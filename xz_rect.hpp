@@ -1,42 +1,48 @@
 #pragma once
-#include <memory>
 #include "hittable.hpp"
 
 class XZRect : public Hittable {
 public:
-    double x0, x1, z0, z1, k; // plane y = k
-    std::shared_ptr<Material> mat;
-    static constexpr double THICK = 1e-4;
-
-    XZRect(double _x0, double _x1, double _z0, double _z1, double _k,
-           std::shared_ptr<Material> m)
-        : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mat(std::move(m)) {}
-
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
-        double denom = r.direction.y;
-        if (std::fabs(denom) < 1e-8) return false;
-        double t = (k - r.origin.y) / denom;
-        if (t < t_min || t > t_max) return false;
+    Real x0, x1, z0, z1, k; // plane y = k
+    MaterialId mat;
+    uint32_t light = NO_LIGHT; // set when the scene collects emitters
+    static constexpr Real THICK = 1e-4;
+
+    XZRect(Real _x0, Real _x1, Real _z0, Real _z1, Real _k,
+           MaterialId m)
+        : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mat(m) {}
 
-        double x = r.origin.x + t * r.direction.x;
-        double z = r.origin.z + t * r.direction.z;
-        if (x < x0 || x > x1 || z < z0 || z > z1) return false;
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        Real t;
+        if (!intersect(r, t_min, t_max, t)) return false;
 
-        rec.t = t;
-        rec.point = r.at(t);
+        rec.set_point(r, t);
         rec.set_face_normal(r, Vec3(0,1,0));
         rec.mat = mat;
+        rec.light = light;
         return true;
     }
 
-    double area() const { return (x1 - x0) * (z1 - z0); }
-    Vec3   sample_point() const {
-        return Vec3(random_double(x0, x1), k, random_double(z0, z1));
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        Real t;
+        return intersect(r, t_min, t_max, t);
     }
-    Vec3   light_normal() const { return Vec3(0,-1,0); }
+
+    Real area() const { return (x1 - x0) * (z1 - z0); }
 
     bool bounding_box(AABB& out_box) const override {
         out_box = AABB(Vec3(x0, k - THICK, z0), Vec3(x1, k + THICK, z1));
         return true;
     }
+
+private:
+    bool intersect(const Ray& r, Real t_min, Real t_max, Real& t) const {
+        if (std::fabs(r.direction.y) < 1e-8) return false;
+        t = (k - r.origin.y) / r.direction.y;
+        if (t < t_min || t > t_max) return false;
+
+        Real x = r.origin.x + t * r.direction.x;
+        Real z = r.origin.z + t * r.direction.z;
+        return !(x < x0 || x > x1 || z < z0 || z > z1);
+    }
 };
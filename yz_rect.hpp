@@ -1,37 +1,48 @@
 #pragma once
-#include <memory>
 #include "hittable.hpp"
 
 class YZRect : public Hittable {
 public:
-    double y0, y1, z0, z1, k; // plane x = k
-    std::shared_ptr<Material> mat;
-    static constexpr double THICK = 1e-4;
+    Real y0, y1, z0, z1, k; // plane x = k
+    MaterialId mat;
+    uint32_t light = NO_LIGHT; // set when the scene collects emitters
+    static constexpr Real THICK = 1e-4;
 
-    YZRect(double _y0, double _y1, double _z0, double _z1, double _k,
-           std::shared_ptr<Material> m)
-        : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mat(std::move(m)) {}
+    YZRect(Real _y0, Real _y1, Real _z0, Real _z1, Real _k,
+           MaterialId m)
+        : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mat(m) {}
 
-    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const override {
-        if (std::fabs(r.direction.x) < 1e-8) return false;
-        double t = (k - r.origin.x) / r.direction.x;
-        if (t < t_min || t > t_max) return false;
-
-        double y = r.origin.y + t * r.direction.y;
-        double z = r.origin.z + t * r.direction.z;
-        if (y < y0 || y > y1 || z < z0 || z > z1) return false;
+    bool hit(const Ray& r, Real t_min, Real t_max, HitRecord& rec) const override {
+        Real t;
+        if (!intersect(r, t_min, t_max, t)) return false;
 
-        rec.t = t;
-        rec.point = r.at(t);
+        rec.set_point(r, t);
         rec.set_face_normal(r, Vec3(1,0,0));
         rec.mat = mat;
+        rec.light = light;
         return true;
     }
 
-    double area() const { return (y1 - y0) * (z1 - z0); }
+    bool occluded(const Ray& r, Real t_min, Real t_max) const override {
+        Real t;
+        return intersect(r, t_min, t_max, t);
+    }
+
+    Real area() const { return (y1 - y0) * (z1 - z0); }
 
     bool bounding_box(AABB& out_box) const override {
         out_box = AABB(Vec3(k - THICK, y0, z0), Vec3(k + THICK, y1, z1));
         return true;
     }
+
+private:
+    bool intersect(const Ray& r, Real t_min, Real t_max, Real& t) const {
+        if (std::fabs(r.direction.x) < 1e-8) return false;
+        t = (k - r.origin.x) / r.direction.x;
+        if (t < t_min || t > t_max) return false;
+
+        Real y = r.origin.y + t * r.direction.y;
+        Real z = r.origin.z + t * r.direction.z;
+        return !(y < y0 || y > y1 || z < z0 || z > z1);
+    }
 };